@@ -0,0 +1,232 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+
+namespace analyzer
+{
+	static constexpr int FFTOrder = 12;
+	static constexpr int FFTSize = 1 << FFTOrder;
+	static constexpr int NumBins = FFTSize / 2;
+	static constexpr int FifoSize = 1 << 15;
+	static constexpr int FramesPerSecond = 30;
+	static constexpr float MinDb = -120.f;
+
+	/*
+	* wait-free single producer, single consumer sample fifo.
+	* the producer drops whatever doesn't fit instead of waiting.
+	*/
+	struct Fifo
+	{
+		Fifo() :
+			data(),
+			writeIdx(0),
+			readIdx(0)
+		{}
+		void push(const float* samples, int numSamples) noexcept
+		{
+			const auto w = writeIdx.load(std::memory_order_relaxed);
+			const auto r = readIdx.load(std::memory_order_acquire);
+			const auto free = FifoSize - 1 - ((w - r) & (FifoSize - 1));
+			numSamples = std::min(numSamples, free);
+			for (auto s = 0; s < numSamples; ++s)
+				data[(w + s) & (FifoSize - 1)] = samples[s];
+			writeIdx.store((w + numSamples) & (FifoSize - 1), std::memory_order_release);
+		}
+		int getNumReady() const noexcept
+		{
+			const auto w = writeIdx.load(std::memory_order_acquire);
+			const auto r = readIdx.load(std::memory_order_relaxed);
+			return (w - r) & (FifoSize - 1);
+		}
+		void skip(int numSamples) noexcept
+		{
+			const auto r = readIdx.load(std::memory_order_relaxed);
+			readIdx.store((r + numSamples) & (FifoSize - 1), std::memory_order_release);
+		}
+		void pull(float* dest, int numSamples) noexcept
+		{
+			const auto r = readIdx.load(std::memory_order_relaxed);
+			for (auto s = 0; s < numSamples; ++s)
+				dest[s] = data[(r + s) & (FifoSize - 1)];
+			skip(numSamples);
+		}
+	protected:
+		std::array<float, FifoSize> data;
+		std::atomic<int> writeIdx, readIdx;
+	};
+
+	using Bins = std::array<float, NumBins>;
+
+	/*
+	* compares the spectrum in front of the downsampling filters to the one behind them.
+	* the audio thread only pushes samples while at least one view is open,
+	* the spectra are computed on the shared Worker thread.
+	* the fifos and the fft are allocated when the first view opens and kept from then on,
+	* so instances whose editor was never opened don't hold them.
+	*/
+	struct Analyzer
+	{
+		Analyzer() :
+			stateOwner(),
+			state(nullptr),
+			lock(),
+			sampleRatePre(44100.), sampleRatePost(44100.),
+			numViews(0),
+			frameIdx(0)
+		{}
+
+		void prepareToPlay(double _sampleRatePre, double _sampleRatePost) noexcept
+		{
+			sampleRatePre.store(_sampleRatePre);
+			sampleRatePost.store(_sampleRatePost);
+		}
+
+		/* audio thread */
+		bool isActive() const noexcept { return numViews.load(std::memory_order_acquire) != 0; }
+		void pushPre(const float* samples, int numSamples) noexcept
+		{
+			if (isActive())
+				state.load(std::memory_order_acquire)->fifoPre.push(samples, numSamples);
+		}
+		void pushPost(const float* samples, int numSamples) noexcept
+		{
+			if (isActive())
+				state.load(std::memory_order_acquire)->fifoPost.push(samples, numSamples);
+		}
+
+		/* worker thread, only called while a view is open */
+		void update()
+		{
+			auto& st = *state.load(std::memory_order_acquire);
+			const auto updatedPre = analyze(st, st.fifoPre, st.binsPreTmp);
+			const auto updatedPost = analyze(st, st.fifoPost, st.binsPostTmp);
+			if (!updatedPre && !updatedPost)
+				return;
+			{
+				const juce::SpinLock::ScopedLockType l(lock);
+				if (updatedPre)
+					st.binsPre = st.binsPreTmp;
+				if (updatedPost)
+					st.binsPost = st.binsPostTmp;
+			}
+			++frameIdx;
+		}
+
+		/* message thread */
+		void addView()
+		{
+			if (stateOwner == nullptr)
+			{ // published before the audio thread can see a view
+				stateOwner = std::make_unique<State>();
+				state.store(stateOwner.get(), std::memory_order_release);
+			}
+			numViews.fetch_add(1, std::memory_order_release);
+		}
+		void removeView() noexcept { --numViews; }
+		int getFrameIdx() const noexcept { return frameIdx.load(); }
+		void getBins(Bins& pre, Bins& post) const noexcept
+		{
+			const auto st = state.load(std::memory_order_acquire);
+			if (st == nullptr)
+			{
+				pre.fill(MinDb);
+				post.fill(MinDb);
+				return;
+			}
+			const juce::SpinLock::ScopedLockType l(lock);
+			pre = st->binsPre;
+			post = st->binsPost;
+		}
+		double getSampleRatePre() const noexcept { return sampleRatePre.load(); }
+		double getSampleRatePost() const noexcept { return sampleRatePost.load(); }
+	protected:
+		struct State
+		{
+			State() :
+				fifoPre(), fifoPost(),
+				fft(FFTOrder),
+				window(),
+				fftBuffer(),
+				binsPre(), binsPost(), binsPreTmp(), binsPostTmp()
+			{
+				for (auto i = 0; i < FFTSize; ++i)
+					window[i] = .5f - .5f * std::cos(6.28318530718f * static_cast<float>(i) / static_cast<float>(FFTSize));
+				binsPre.fill(MinDb);
+				binsPost.fill(MinDb);
+			}
+			Fifo fifoPre, fifoPost;
+			juce::dsp::FFT fft;
+			std::array<float, FFTSize> window;
+			std::array<float, FFTSize * 2> fftBuffer;
+			Bins binsPre, binsPost, binsPreTmp, binsPostTmp;
+		};
+
+		std::unique_ptr<State> stateOwner;
+		std::atomic<State*> state;
+		juce::SpinLock lock;
+		std::atomic<double> sampleRatePre, sampleRatePost;
+		std::atomic<int> numViews, frameIdx;
+
+		static bool analyze(State& st, Fifo& fifo, Bins& bins)
+		{
+			auto& fftBuffer = st.fftBuffer;
+			const auto numReady = fifo.getNumReady();
+			if (numReady < FFTSize)
+				return false;
+			// only the latest frame is analyzed, everything older gets dropped
+			fifo.skip(numReady - FFTSize);
+			fifo.pull(fftBuffer.data(), FFTSize);
+			for (auto i = 0; i < FFTSize; ++i)
+				fftBuffer[i] *= st.window[i];
+			st.fft.performFrequencyOnlyForwardTransform(fftBuffer.data());
+			const auto gain = 4.f / static_cast<float>(FFTSize);
+			for (auto b = 0; b < NumBins; ++b)
+				bins[b] = juce::Decibels::gainToDecibels(fftBuffer[b] * gain, MinDb);
+			return true;
+		}
+	};
+
+	/*
+	* a single thread that serves all open analyzer views of all instances,
+	* so GUI cost doesn't grow with the number of threads.
+	*/
+	struct Worker :
+		public juce::Thread
+	{
+		Worker() :
+			juce::Thread("Analyzer"),
+			analyzers(),
+			lock()
+		{
+			startThread();
+		}
+		~Worker() override { stopThread(1000); }
+
+		void add(Analyzer* a)
+		{
+			const juce::ScopedLock l(lock);
+			analyzers.addIfNotAlreadyThere(a);
+		}
+		void remove(Analyzer* a)
+		{
+			const juce::ScopedLock l(lock);
+			analyzers.removeFirstMatchingValue(a);
+		}
+	protected:
+		juce::Array<Analyzer*> analyzers;
+		juce::CriticalSection lock;
+
+		void run() override
+		{
+			while (!threadShouldExit())
+			{
+				{
+					const juce::ScopedLock l(lock);
+					for (auto a : analyzers)
+						a->update();
+				}
+				wait(1000 / FramesPerSecond);
+			}
+		}
+	};
+}
@@ -0,0 +1,427 @@
+#pragma once
+#include <JuceHeader.h>
+#include "NonLinearDSP.h"
+#include <vector>
+
+/*
+* frozen copies of the scalar implementations that the optimized kernels replaced,
+* the golden references of Equivalence.h.
+* never optimize, fix or restyle anything in here, a change would move what the kernels are compared to.
+*
+* IIR, Convolution and Processor are the baseline's, up to the Processor working in place without a host.
+* the vibrato's own baseline is a different algorithm, its reference is the scalar version
+* from right before the kernels were dispatched per isa.
+*/
+namespace baseline
+{
+	using Buffer = std::vector<float>;
+
+	struct IIR
+	{
+		IIR() :
+			a0(1.f), a1(0.f), a2(0.f), a3(0.f), a4(0.f),
+			b1(0.f), b2(0.f), b3(0.f), b4(0.f),
+			x1(0.f), x2(0.f), x3(0.f), x4(0.f),
+			y1(0.f), y2(0.f), y3(0.f), y4(0.f)
+		{}
+		void makeChebyshev_lp_4pole_fc45_ripl5() noexcept
+		{
+			a0 = 6.291693e-01f;
+			a1 = 2.516677e+00f;
+			a2 = 3.775016e+00f;
+			a3 = 2.516677e+00f;
+			a4 = 6.291693e-01f;
+			b1 = -3.077062e+00f;
+			b2 = -3.641323e+00f;
+			b3 = -1.949229e+00f;
+			b4 = -3.990945e-01f;
+		}
+		void processBlock(float* samples, int numSamples) noexcept
+		{
+			for (auto s = 0; s < numSamples; ++s)
+				samples[s] = processSample(samples[s]);
+		}
+		float processSample(float x0) noexcept
+		{
+			const auto y0 =
+				x0 * a0
+				+ x1 * a1
+				+ x2 * a2
+				+ x3 * a3
+				+ x4 * a4
+				+ y1 * b1
+				+ y2 * b2
+				+ y3 * b3
+				+ y4 * b4;
+
+			x4 = x3;
+			x3 = x2;
+			x2 = x1;
+			x1 = x0;
+
+			y4 = y3;
+			y3 = y2;
+			y2 = y1;
+			y1 = y0;
+
+			return y0;
+		}
+	protected:
+		float a0, a1, a2, a3, a4, b1, b2, b3, b4;
+		float x1, x2, x3, x4, y1, y2, y3, y4;
+	};
+
+	inline Buffer makeSincFilter2(float Fs, float fc, float bw, bool upsampling)
+	{
+		static constexpr float tau = 6.28318530718f;
+		static constexpr float tau2 = tau * 2.f;
+
+		const auto nyquist = Fs * .5f;
+		if (fc > nyquist || bw > nyquist || fc + bw > nyquist)
+			return Buffer(1, 1.f);
+		fc /= Fs;
+		bw /= Fs;
+		int M = static_cast<int>(4.f / bw);
+		if (M % 2 != 0) M += 1;
+		const auto MHalf = static_cast<float>(M) * .5f;
+		const float MInv = 1.f / static_cast<float>(M);
+		const int N = M + 1;
+
+		const auto h = [&](float i)
+		{
+			i -= MHalf;
+			if (i != 0.f)
+				return std::sin(tau * fc * i) / i;
+			return tau * fc;
+		};
+		const auto w = [&](float i)
+		{
+			i *= MInv;
+			return .42f - .5f * std::cos(tau * i) + .08f * std::cos(tau2 * i);
+		};
+
+		Buffer ir;
+		ir.reserve(N);
+		for (auto n = 0; n < N; ++n)
+		{
+			auto nF = static_cast<float>(n);
+			ir.emplace_back(h(nF) * w(nF));
+		}
+
+		const auto targetGain = upsampling ? 2.f : 1.f;
+		auto sum = 0.f;
+		for (const auto n : ir)
+			sum += n;
+		const auto sumInv = targetGain / sum;
+		for (auto& n : ir)
+			n *= sumInv;
+
+		return ir;
+	}
+
+	/* one channel of a fir, ring buffer, newest sample first */
+	struct Convolution
+	{
+		Convolution(const Buffer& ir) :
+			buffer(ir.size(), 0.f),
+			wIdx(0)
+		{}
+		void processBlock(float* audioBuffer, const Buffer& ir, const int numSamples) noexcept
+		{
+			const auto irSize = static_cast<int>(ir.size());
+			for (auto s = 0; s < numSamples; ++s)
+			{
+				++wIdx;
+				if (wIdx == irSize)
+					wIdx = 0;
+				buffer[wIdx] = audioBuffer[s];
+
+				auto y = 0.f;
+				auto rIdx = wIdx;
+				for (auto i = 0; i < irSize; ++i)
+				{
+					y += buffer[rIdx] * ir[i];
+					--rIdx;
+					if (rIdx == -1)
+						rIdx = irSize - 1;
+				}
+				audioBuffer[s] = y;
+			}
+		}
+		/* numSamples of a zero stuffed signal, only the even ones are read */
+		void processBlockUp(float* audioBuffer, const Buffer& ir, const int numSamples) noexcept
+		{
+			for (auto s = 0; s < numSamples; s += 2)
+			{
+				audioBuffer[s] = processSampleUpEven(audioBuffer[s], ir);
+				audioBuffer[s + 1] = processSampleUpOdd(ir);
+			}
+		}
+		float processSampleUpEven(const float sample, const Buffer& ir) noexcept
+		{
+			const auto irSize = static_cast<int>(ir.size());
+			buffer[wIdx] = sample;
+			auto y = 0.f;
+			auto rIdx = wIdx;
+			for (auto i = 0; i < irSize; i += 2)
+			{
+				y += buffer[rIdx] * ir[i];
+				rIdx -= 2;
+				if (rIdx < 0)
+					rIdx += irSize;
+			}
+			++wIdx;
+			if (wIdx == irSize)
+				wIdx = 0;
+			return y;
+		}
+		float processSampleUpOdd(const Buffer& ir) noexcept
+		{
+			const auto irSize = static_cast<int>(ir.size());
+			auto y = 0.f;
+			auto rIdx = wIdx - 1;
+			if (rIdx == -1)
+				rIdx = irSize - 1;
+			buffer[wIdx] = 0.f;
+			for (auto i = 1; i < irSize; i += 2)
+			{
+				y += buffer[rIdx] * ir[i];
+				rIdx -= 2;
+				if (rIdx < 0)
+					rIdx += irSize;
+			}
+			++wIdx;
+			if (wIdx == irSize)
+				wIdx = 0;
+			return y;
+		}
+	protected:
+		Buffer buffer;
+		int wIdx;
+	};
+
+	/* a fir per channel with the same impulse response */
+	struct ConvolutionFilter
+	{
+		ConvolutionFilter(int _numChannels, const Buffer& _ir) :
+			filters(_numChannels, Convolution(_ir)),
+			ir(_ir),
+			numChannels(_numChannels)
+		{}
+		void processBlockDown(float** audioBuffer, int numSamples) noexcept
+		{
+			for (auto ch = 0; ch < numChannels; ++ch)
+				filters[ch].processBlock(audioBuffer[ch], ir, numSamples);
+		}
+		void processBlockUp(float** audioBuffer, int numSamples) noexcept
+		{
+			for (auto ch = 0; ch < numChannels; ++ch)
+				filters[ch].processBlockUp(audioBuffer[ch], ir, numSamples);
+		}
+	protected:
+		std::vector<Convolution> filters;
+		Buffer ir;
+		int numChannels;
+	};
+
+	struct LowkeyChebyshevFilter
+	{
+		LowkeyChebyshevFilter(int _numChannels) :
+			filters(_numChannels),
+			numChannels(_numChannels)
+		{
+			for (auto& filter : filters)
+				filter.makeChebyshev_lp_4pole_fc45_ripl5();
+		}
+		void processBlock(float** audioBuffer, const int numSamples) noexcept
+		{
+			for (auto ch = 0; ch < numChannels; ++ch)
+				filters[ch].processBlock(audioBuffer[ch], numSamples);
+		}
+	protected:
+		std::vector<IIR> filters;
+		int numChannels;
+	};
+
+	/* the baseline's 4x oversampling: chebyshev iir for 2x, windowed sinc for 4x */
+	struct Processor
+	{
+		Processor(int _numChannels) :
+			filterUp4(_numChannels, makeSincFilter2(176400.f, 22050.f, 44100.f, true)),
+			filterDown4(_numChannels, makeSincFilter2(176400.f, 22050.f, 44100.f, false)),
+			filterUp2(_numChannels),
+			filterDown2(_numChannels),
+			numChannels(_numChannels),
+			numSamples1x(0), numSamples2x(0), numSamples4x(0)
+		{}
+		/* samplesUp has the input in front and room for numSamples * 4 */
+		void upsample(float** samplesUp, int numSamples) noexcept
+		{
+			numSamples1x = numSamples;
+			numSamples2x = numSamples1x * 2;
+			numSamples4x = numSamples1x * 4;
+			// zero stuffing + filter 2x
+			for (auto ch = 0; ch < numChannels; ++ch)
+			{
+				auto up = samplesUp[ch];
+				for (auto s = numSamples1x - 1; s > -1; --s)
+				{
+					const auto s2 = s * 2;
+					up[s2] = up[s];
+					up[s2 + 1] = 0.f;
+				}
+			}
+			filterUp2.processBlock(samplesUp, numSamples2x);
+			// zero stuffing + filter 4x
+			const auto maxSample2x = numSamples2x - 1;
+			for (auto ch = 0; ch < numChannels; ++ch)
+			{
+				auto up = samplesUp[ch];
+				for (auto s = maxSample2x; s > -1; --s)
+				{
+					const auto s2 = s * 2;
+					up[s2] = up[s] * 2.f;
+					up[s2 + 1] = 0.f;
+				}
+			}
+			filterUp4.processBlockUp(samplesUp, numSamples4x);
+		}
+		/* back into the first numSamples1x of samplesUp */
+		void downsample(float** samplesUp) noexcept
+		{
+			filterDown4.processBlockDown(samplesUp, numSamples4x);
+			for (auto ch = 0; ch < numChannels; ++ch)
+				for (auto s = 0; s < numSamples2x; ++s)
+					samplesUp[ch][s] = samplesUp[ch][s * 2];
+			filterDown2.processBlock(samplesUp, numSamples2x);
+			for (auto ch = 0; ch < numChannels; ++ch)
+				for (auto s = 0; s < numSamples1x; ++s)
+					samplesUp[ch][s] = samplesUp[ch][s * 2];
+		}
+	protected:
+		ConvolutionFilter filterUp4, filterDown4;
+		LowkeyChebyshevFilter filterUp2, filterDown2;
+		int numChannels;
+		int numSamples1x, numSamples2x, numSamples4x;
+	};
+
+	struct Vibrato
+	{
+		static constexpr int ControlRate = 32;
+
+		Vibrato() :
+			ringBuffer(),
+			interpolation(dsp::Interpolation::Cubic),
+			depth(1.f),
+			delay(0.f), delayInc(0.f), apState(0.f),
+			fsInv(0.f), phase(0.f), inc(0.f),
+			writeHead(0), size(0), mask(0), controlIdx(0)
+		{}
+		void prepareToPlay(double sampleRate, int) {
+			size = static_cast<int>(sampleRate * 7. / 1000.);
+			fsInv = static_cast<float>(2. / (sampleRate / static_cast<double>(ControlRate)));
+			inc = fsInv;
+			auto ringSize = 1;
+			while (ringSize < size + 4)
+				ringSize <<= 1;
+			mask = ringSize - 1;
+			ringBuffer.assign(ringSize * 2, 0.f);
+			writeHead = 0;
+			controlIdx = 0;
+			delay = static_cast<float>(size) * .5f;
+			delayInc = 0.f;
+			apState = 0.f;
+		}
+		void setFrequency(float f) noexcept { inc = f * fsInv; }
+		void setDepth(float d) noexcept { depth = d; }
+		void setInterpolation(dsp::Interpolation i) noexcept { interpolation = i; }
+		void process(float* samples, int numSamples) noexcept
+		{
+			switch (interpolation)
+			{
+			case dsp::Interpolation::Linear: return process<dsp::Interpolation::Linear>(samples, numSamples);
+			case dsp::Interpolation::Cubic: return process<dsp::Interpolation::Cubic>(samples, numSamples);
+			case dsp::Interpolation::Lagrange: return process<dsp::Interpolation::Lagrange>(samples, numSamples);
+			case dsp::Interpolation::Allpass: return process<dsp::Interpolation::Allpass>(samples, numSamples);
+			}
+		}
+	protected:
+		std::vector<float> ringBuffer;
+		dsp::Interpolation interpolation;
+		float depth, delay, delayInc, apState;
+		float fsInv, phase, inc;
+		int writeHead, size, mask, controlIdx;
+
+		/* the lfo, a phasor into the sine polynomial */
+		float processLFO() noexcept
+		{
+			phase += inc;
+			if (phase >= 1.f)
+				phase -= 2.f;
+			auto x = std::copysign(.5f - std::abs(std::abs(phase) - .5f), phase);
+			const auto xx = x * x;
+			return x * (3.14158202f + xx * (-5.16714273f + xx * (2.54189841f + xx * -.55463455f)));
+		}
+
+		void tick() noexcept
+		{
+			if (controlIdx == 0)
+			{
+				const auto lfoNormal = .9f * depth * processLFO() * .5f + .5f;
+				const auto target = lfoNormal * static_cast<float>(size);
+				delayInc = (target - delay) * (1.f / static_cast<float>(ControlRate));
+			}
+			controlIdx = (controlIdx + 1) & (ControlRate - 1);
+			delay += delayInc;
+		}
+
+		template<dsp::Interpolation Interp>
+		void process(float* samples, int numSamples) noexcept
+		{
+			const auto ringSize = mask + 1;
+			auto buf = ringBuffer.data();
+			for (auto s = 0; s < numSamples; ++s)
+			{
+				tick();
+
+				writeHead = (writeHead + 1) & mask;
+				buf[writeHead] = buf[writeHead + ringSize] = samples[s];
+				samples[s] = read<Interp>(buf);
+			}
+		}
+
+		template<dsp::Interpolation Interp>
+		float read(const float* buf) noexcept
+		{
+			if (Interp == dsp::Interpolation::Allpass)
+			{
+				const auto m = static_cast<int>(delay - .5f);
+				const auto d = delay - static_cast<float>(m);
+				const auto eta = (1.f - d) / (1.f + d);
+				const auto x = buf + ((writeHead - m - 1) & mask);
+				apState = eta * (x[1] - apState) + x[0];
+				return apState;
+			}
+			const auto m = static_cast<int>(delay);
+			const auto t = delay - static_cast<float>(m);
+			const auto x = buf + ((writeHead - m - 2) & mask);
+			if (Interp == dsp::Interpolation::Linear)
+				return x[2] + t * (x[1] - x[2]);
+			if (Interp == dsp::Interpolation::Cubic)
+			{
+				const auto c1 = .5f * (x[1] - x[3]);
+				const auto c2 = x[3] - 2.5f * x[2] + 2.f * x[1] - .5f * x[0];
+				const auto c3 = .5f * (x[0] - x[3]) + 1.5f * (x[2] - x[1]);
+				return ((c3 * t + c2) * t + c1) * t + x[2];
+			}
+			const auto tP1 = t + 1.f;
+			const auto tM1 = t - 1.f;
+			const auto tM2 = t - 2.f;
+			return
+				- x[3] * t * tM1 * tM2 * (1.f / 6.f)
+				+ x[2] * tP1 * tM1 * tM2 * .5f
+				- x[1] * tP1 * t * tM2 * .5f
+				+ x[0] * tP1 * t * tM1 * (1.f / 6.f);
+		}
+	};
+}
@@ -0,0 +1,346 @@
+#pragma once
+#include <JuceHeader.h>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+/*
+* opt-in recording of everything the audio thread gets from the host, for replaying it offline.
+* the audio thread copies each block with its parameter snapshot into a lock-free ring,
+* a background thread streams the ring into a capture file.
+*
+* file layout: FileHeader, then Records. a Prepare record stands for a prepareToPlay,
+* a Block record is followed by numParams floats and numChannels * numSamples floats, channel by channel.
+* native byte order, like the coefficient store it's not meant to be moved between machines.
+*/
+namespace capture
+{
+	static constexpr juce::uint32 Magic = 0x5043534f; // "OSCP"
+	static constexpr juce::uint32 Version = 1;
+	static constexpr int RingSize = 1 << 23; // bytes, a few seconds of stereo at 192khz
+	static constexpr int FlushIntervalMs = 20;
+
+	enum class Type : juce::uint32 { Prepare, Block };
+	/* state a Prepare record carries besides the rate and block size, Bypassed is for Block records */
+	enum Flags : juce::uint32 { NonRealtime = 1, OversamplingEnabled = 2, Draft = 4, Bypassed = 8 };
+
+	struct FileHeader
+	{
+		juce::uint32 magic, version, numParams, reserved;
+	};
+	struct Record
+	{
+		Type type;
+		juce::uint32 flags;
+		juce::int32 numChannels; // prepare: output channels, block: channels of the buffer
+		juce::int32 numChannelsIn; // prepare only
+		juce::int32 numSamples; // prepare: max block size
+		juce::uint32 numDropped; // blocks lost right before this record, because the ring was full
+		double sampleRate; // prepare only
+	};
+
+	inline juce::File getDefaultFolder()
+	{
+		return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+			.getChildFile("OversamplingTest").getChildFile("captures");
+	}
+
+	/* single producer (audio thread), single consumer (capture thread), whole records only */
+	struct Ring
+	{
+		Ring() :
+			data(),
+			writeIdx(0),
+			readIdx(0)
+		{}
+		/* message thread, before anything is pushed */
+		void allocate()
+		{
+			if (data.empty())
+				data.resize(RingSize);
+		}
+		int getNumFree() const noexcept
+		{
+			return (readIdx.load(std::memory_order_acquire) - writeIdx.load(std::memory_order_relaxed) - 1) & (RingSize - 1);
+		}
+		/* parts are written one after the other and published together */
+		void write(int& w, const void* src, int numBytes) noexcept
+		{
+			const auto bytes = static_cast<const char*>(src);
+			const auto n = std::min(numBytes, RingSize - w);
+			std::memcpy(data.data() + w, bytes, static_cast<size_t>(n));
+			std::memcpy(data.data(), bytes + n, static_cast<size_t>(numBytes - n));
+			w = (w + numBytes) & (RingSize - 1);
+		}
+		int beginWrite() const noexcept { return writeIdx.load(std::memory_order_relaxed); }
+		void endWrite(int w) noexcept { writeIdx.store(w, std::memory_order_release); }
+
+		/* writes everything published so far to stream */
+		void drain(juce::OutputStream& stream)
+		{
+			const auto r = readIdx.load(std::memory_order_relaxed);
+			const auto w = writeIdx.load(std::memory_order_acquire);
+			if (r == w)
+				return;
+			if (w > r)
+				stream.write(data.data() + r, static_cast<size_t>(w - r));
+			else
+			{
+				stream.write(data.data() + r, static_cast<size_t>(RingSize - r));
+				stream.write(data.data(), static_cast<size_t>(w));
+			}
+			readIdx.store(w, std::memory_order_release);
+		}
+		/* forgets what wasn't drained, only while the consumer isn't draining */
+		void skip() noexcept { readIdx.store(writeIdx.load(std::memory_order_acquire), std::memory_order_release); }
+	protected:
+		std::vector<char> data;
+		std::atomic<int> writeIdx, readIdx;
+	};
+
+	struct Recorder :
+		public juce::Thread
+	{
+		Recorder(int _numParams) :
+			juce::Thread("Capture"),
+			ring(),
+			stream(),
+			lastPrepare{ Type::Prepare, 0, 0, 0, 0, 0, 0. },
+			numParams(_numParams),
+			numDropped(0),
+			generation(0), ackedGeneration(0),
+			recording(false),
+			needsPrepare(false)
+		{}
+		~Recorder() override { stopRecording(); }
+
+		/* message thread. returns false if file can't be written */
+		bool startRecording(const juce::File& file)
+		{
+			stopRecording();
+			file.getParentDirectory().createDirectory();
+			file.deleteFile();
+			auto s = std::make_unique<juce::FileOutputStream>(file);
+			if (!s->openedOk())
+				return false;
+			const FileHeader header{ Magic, Version, static_cast<juce::uint32>(numParams), 0 };
+			s->write(&header, sizeof(FileHeader));
+			stream = std::move(s);
+			ring.allocate();
+			// the audio thread resets the ring and the drop count with its next push,
+			// a push that is still busy with the last recording can't be cut off that way
+			generation.fetch_add(1, std::memory_order_release);
+			needsPrepare.store(true);
+			recording.store(true, std::memory_order_release);
+			startThread();
+			return true;
+		}
+		/* message thread, the file is complete once this returns */
+		void stopRecording()
+		{
+			recording.store(false);
+			stopThread(1000);
+			stream.reset();
+		}
+		bool isRecording() const noexcept { return recording.load(); }
+		/* blocks lost since recording started */
+		int getNumDropped() const noexcept { return static_cast<int>(numDropped.load(std::memory_order_relaxed)); }
+
+		/* audio thread, or wherever prepareToPlay runs. remembered for when a recording starts later */
+		void prepare(double sampleRate, int maxBlockSize, int numChannelsIn, int numChannelsOut, juce::uint32 flags) noexcept
+		{
+			lastPrepare = { Type::Prepare, flags, numChannelsOut, numChannelsIn, maxBlockSize, 0, sampleRate };
+			if (isRecording())
+				needsPrepare.store(true);
+		}
+		/* audio thread. params has numParams values, bypassed if the host called processBlockBypassed */
+		void push(const juce::AudioBuffer<float>& buffer, const float* params, bool bypassed = false) noexcept
+		{
+			if (!recording.load(std::memory_order_acquire))
+				return;
+			const auto g = generation.load(std::memory_order_acquire);
+			if (g != ackedGeneration.load(std::memory_order_relaxed))
+			{ // new recording, the capture thread doesn't drain until this is acknowledged
+				ring.skip();
+				numDropped.store(0, std::memory_order_relaxed);
+				ackedGeneration.store(g, std::memory_order_release);
+			}
+			if (needsPrepare.load() && pushRecord(lastPrepare, nullptr, nullptr))
+				needsPrepare.store(false);
+			const Record block{ Type::Block, bypassed ? Bypassed : 0u, buffer.getNumChannels(), 0, buffer.getNumSamples(), 0, 0. };
+			pushRecord(block, params, &buffer);
+		}
+	protected:
+		Ring ring;
+		std::unique_ptr<juce::FileOutputStream> stream;
+		Record lastPrepare;
+		int numParams;
+		std::atomic<juce::uint32> numDropped, generation, ackedGeneration;
+		std::atomic<bool> recording, needsPrepare;
+
+		bool pushRecord(Record record, const float* params, const juce::AudioBuffer<float>* buffer) noexcept
+		{
+			auto numBytes = static_cast<int>(sizeof(Record));
+			if (buffer != nullptr)
+				numBytes += static_cast<int>(sizeof(float)) * (numParams + record.numChannels * record.numSamples);
+			if (numBytes > ring.getNumFree())
+			{
+				numDropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			record.numDropped = numDropped.load(std::memory_order_relaxed); // lost ones are counted, so the replay knows about the gap
+			auto w = ring.beginWrite();
+			ring.write(w, &record, sizeof(Record));
+			if (buffer != nullptr)
+			{
+				ring.write(w, params, numParams * static_cast<int>(sizeof(float)));
+				for (auto ch = 0; ch < record.numChannels; ++ch)
+					ring.write(w, buffer->getReadPointer(ch), record.numSamples * static_cast<int>(sizeof(float)));
+			}
+			ring.endWrite(w);
+			return true;
+		}
+
+		/* the ring only belongs to this recording once the audio thread acknowledged it */
+		bool isAcknowledged() const noexcept
+		{
+			return ackedGeneration.load(std::memory_order_acquire) == generation.load(std::memory_order_relaxed);
+		}
+
+		void run() override
+		{
+			while (!threadShouldExit())
+			{
+				wait(FlushIntervalMs);
+				if (isAcknowledged())
+					ring.drain(*stream);
+			}
+			if (isAcknowledged())
+				ring.drain(*stream);
+			stream->flush();
+		}
+	};
+
+	/* reads the records of a capture file in order */
+	struct Reader
+	{
+		Reader(const juce::File& file) :
+			stream(file),
+			numParams(0),
+			valid(false)
+		{
+			FileHeader header;
+			if (!stream.openedOk() || stream.read(&header, sizeof(FileHeader)) != sizeof(FileHeader))
+				return;
+			valid = header.magic == Magic && header.version == Version;
+			numParams = static_cast<int>(header.numParams);
+		}
+		bool isValid() const noexcept { return valid; }
+		int getNumParams() const noexcept { return numParams; }
+		/* false at the end of the file, a truncated last record counts as the end */
+		bool next(Record& record, juce::AudioBuffer<float>& buffer, std::vector<float>& params)
+		{
+			if (!valid || stream.read(&record, sizeof(Record)) != sizeof(Record))
+				return false;
+			if (record.type != Type::Block)
+				return record.type == Type::Prepare;
+			if (record.numChannels < 0 || record.numSamples < 0)
+				return false;
+			params.resize(static_cast<size_t>(numParams));
+			if (!readFloats(params.data(), numParams))
+				return false;
+			buffer.setSize(record.numChannels, record.numSamples, false, false, true);
+			for (auto ch = 0; ch < record.numChannels; ++ch)
+				if (!readFloats(buffer.getWritePointer(ch), record.numSamples))
+					return false;
+			return true;
+		}
+	protected:
+		juce::FileInputStream stream;
+		int numParams;
+		bool valid;
+
+		bool readFloats(float* dest, int num)
+		{
+			const auto numBytes = num * static_cast<int>(sizeof(float));
+			return stream.read(dest, numBytes) == numBytes;
+		}
+	};
+
+	/* where the time went when a capture was replayed. load is relative to the block's duration */
+	struct BlockCost
+	{
+		juce::int64 index;
+		int numSamples;
+		double ms, load;
+	};
+	struct Report
+	{
+		juce::int64 numBlocks, numPrepares, numDropped;
+		double totalMs, audioMs;
+		std::vector<BlockCost> worst; // most expensive first
+
+		/* csv, the totals in the first row */
+		juce::String toString() const
+		{
+			juce::String str("blocks,prepares,dropped,total ms,audio ms\n");
+			str += juce::String(numBlocks) + "," + juce::String(numPrepares) + "," + juce::String(numDropped)
+				+ "," + juce::String(totalMs) + "," + juce::String(audioMs) + "\n";
+			str += "block,samples,ms,load\n";
+			for (const auto& w : worst)
+				str += juce::String(w.index) + "," + juce::String(w.numSamples)
+					+ "," + juce::String(w.ms) + "," + juce::String(w.load) + "\n";
+			return str;
+		}
+	};
+
+	using PrepareFunc = std::function<void(const Record& record)>;
+	using ProcessFunc = std::function<void(juce::AudioBuffer<float>& buffer, const std::vector<float>& params, bool bypassed)>;
+
+	/*
+	* feeds the records of a capture to prepare and process in the order they were recorded,
+	* with the same block sizes, and times every process call.
+	* returns an empty report if the file isn't a capture
+	*/
+	inline Report replay(const juce::File& file, const PrepareFunc& prepare, const ProcessFunc& process, int numWorst = 16)
+	{
+		Report report{ 0, 0, 0, 0., 0., {} };
+		Reader reader(file);
+		if (!reader.isValid())
+			return report;
+		const auto tickToMs = 1000. / static_cast<double>(juce::Time::getHighResolutionTicksPerSecond());
+		Record record;
+		juce::AudioBuffer<float> buffer;
+		std::vector<float> params;
+		auto sampleRate = 44100.;
+		while (reader.next(record, buffer, params))
+		{
+			report.numDropped = record.numDropped;
+			if (record.type == Type::Prepare)
+			{
+				sampleRate = record.sampleRate;
+				prepare(record);
+				++report.numPrepares;
+				continue;
+			}
+			const auto start = juce::Time::getHighResolutionTicks();
+			process(buffer, params, (record.flags & Bypassed) != 0);
+			const auto ms = static_cast<double>(juce::Time::getHighResolutionTicks() - start) * tickToMs;
+			const auto blockMs = 1000. * static_cast<double>(record.numSamples) / sampleRate;
+			report.totalMs += ms;
+			report.audioMs += blockMs;
+
+			const BlockCost cost{ report.numBlocks++, record.numSamples, ms, blockMs > 0. ? ms / blockMs : 0. };
+			const auto pos = std::upper_bound(report.worst.begin(), report.worst.end(), cost,
+				[](const BlockCost& a, const BlockCost& b) { return a.ms > b.ms; });
+			if (pos - report.worst.begin() < numWorst)
+			{
+				report.worst.insert(pos, cost);
+				if (static_cast<int>(report.worst.size()) > numWorst)
+					report.worst.pop_back();
+			}
+		}
+		return report;
+	}
+}
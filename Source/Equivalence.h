@@ -0,0 +1,721 @@
+#pragma once
+#include <JuceHeader.h>
+#include "NonLinearDSP.h"
+#include "Baseline.h"
+#include <functional>
+
+/*
+* golden output checks for the optimized kernels.
+* every kernel runs once per instruction set the cpu supports, on randomized signals, block sizes
+* (down to 1 and odd ones) and channel counts, and is compared to a reference that doesn't share its code:
+* direct convolution in double (also of the polynomial interpolators), the folding and saturation formulas in double,
+* and the frozen scalar implementations in Baseline.h for the iir, the stage chains and the vibrato,
+* so a regression that every isa shares, the generic build included, still fails.
+* timings go into the same report, so a speedup is never looked at without its error.
+*
+* run by the tools' test command, Harness can also be used on its own, e.g. from a debugger.
+*/
+namespace equivalence
+{
+	using ISA = oversampling::ISA;
+
+	/* signals are around full scale, ulps below this magnitude would only measure cancellation */
+	static constexpr double UlpFloor = 1. / 16.;
+
+	struct Tolerance
+	{
+		double maxAbs, maxUlps;
+	};
+
+	struct Error
+	{
+		Error() :
+			maxAbs(0.),
+			maxUlps(0.)
+		{}
+		void add(float value, double reference) noexcept
+		{
+			if (!std::isfinite(value))
+			{
+				maxAbs = maxUlps = std::numeric_limits<double>::infinity();
+				return;
+			}
+			const auto e = std::abs(static_cast<double>(value) - reference);
+			const auto mag = static_cast<float>(std::max(std::abs(reference), UlpFloor));
+			const auto ulp = static_cast<double>(std::nextafter(mag, std::numeric_limits<float>::infinity()) - mag);
+			maxAbs = std::max(maxAbs, e);
+			maxUlps = std::max(maxUlps, std::ceil(e / ulp));
+		}
+		void add(const float* values, const float* references, int numSamples) noexcept
+		{
+			for (auto s = 0; s < numSamples; ++s)
+				add(values[s], static_cast<double>(references[s]));
+		}
+
+		double maxAbs, maxUlps;
+	};
+
+	struct Measurement
+	{
+		Error error;
+		juce::int64 ticks, numSamples;
+	};
+
+	struct Result
+	{
+		juce::String kernel;
+		ISA isa;
+		Error error;
+		Tolerance tolerance;
+		double ns; // per sample and channel
+		double speedup; // over the generic build
+
+		bool passed() const noexcept
+		{
+			return error.maxAbs <= tolerance.maxAbs && error.maxUlps <= tolerance.maxUlps;
+		}
+	};
+
+	struct Report
+	{
+		bool passed() const noexcept
+		{
+			for (const auto& r : results)
+				if (!r.passed())
+					return false;
+			return true;
+		}
+		/* csv */
+		juce::String toString() const
+		{
+			juce::String str("kernel,isa,maxAbs,maxUlps,toleranceAbs,toleranceUlps,ns,speedup,passed\n");
+			for (const auto& r : results)
+				str += r.kernel + "," + oversampling::toString(r.isa)
+					+ "," + juce::String(r.error.maxAbs) + "," + juce::String(r.error.maxUlps)
+					+ "," + juce::String(r.tolerance.maxAbs) + "," + juce::String(r.tolerance.maxUlps)
+					+ "," + juce::String(r.ns) + "," + juce::String(r.speedup)
+					+ "," + (r.passed() ? "1" : "0") + "\n";
+			return str;
+		}
+
+		std::vector<Result> results;
+	};
+
+	struct Harness
+	{
+		static constexpr int MaxNumChannels = 4;
+		static constexpr int NumSamplesPerRun = 1 << 13;
+		/*
+		* the chebyshev's poles are close to the unit circle, so a rounding difference keeps circulating.
+		* alone it matches the baseline exactly without fma. fma contraction, or the fir's summation order
+		* in front of it in the realtime chain, stay below 7e-5 and 9400 ulps over 256 seeds.
+		* the tolerance leaves twice that
+		*/
+		static constexpr Tolerance ChebyshevTolerance{ 1.4e-4, 18800. };
+
+		/* the same seed gives the same signals, block sizes and channel counts */
+		Harness(juce::int64 _seed = 420, int _numRuns = 4) :
+			seed(_seed),
+			numRuns(_numRuns)
+		{}
+
+		/* changes the isa of the whole process while it runs, not while audio is playing */
+		Report run()
+		{
+			const auto isa = oversampling::getISA();
+			Report report;
+			checkConvolution(report);
+			checkPolynomial(report);
+			checkIIR(report);
+			checkStages(report);
+			checkNonLinear(report);
+			oversampling::forceISA(isa);
+			return report;
+		}
+	protected:
+		/* isa is the one the kernel runs with, it is forced before the case runs. references never dispatch */
+		using Case = std::function<void(juce::Random&, ISA, Measurement&)>;
+
+		juce::int64 seed;
+		int numRuns;
+
+		void check(Report& report, const juce::String& kernel, const Tolerance& tolerance, const Case& c)
+		{
+			const auto numISAs = static_cast<int>(oversampling::detectISA()) + 1;
+			auto nsGeneric = 0.;
+			for (auto i = 0; i < numISAs; ++i)
+			{
+				const auto isa = static_cast<ISA>(i);
+				Measurement m{ {}, 0, 0 };
+				for (auto r = 0; r < numRuns; ++r)
+				{
+					juce::Random rand(seed + r);
+					oversampling::forceISA(isa);
+					c(rand, isa, m);
+				}
+				const auto ns = juce::Time::highResolutionTicksToSeconds(m.ticks) * 1e9 / static_cast<double>(std::max(m.numSamples, static_cast<juce::int64>(1)));
+				if (isa == ISA::Generic)
+					nsGeneric = ns;
+				report.results.push_back({ kernel, isa, m.error, tolerance, ns, ns > 0. ? nsGeneric / ns : 0. });
+			}
+		}
+
+		template<typename Func>
+		static void time(Measurement& m, int numSamples, Func&& func)
+		{
+			const auto start = juce::Time::getHighResolutionTicks();
+			func();
+			m.ticks += juce::Time::getHighResolutionTicks() - start;
+			m.numSamples += numSamples;
+		}
+
+		/* 1 and odd sizes catch remainders, the others chunk boundaries of the kernels */
+		static std::vector<int> makeBlockSizes(juce::Random& rand, int numSamples)
+		{
+			static constexpr int Sizes[] = { 1, 2, 3, 7, 16, 33, 63, 64, 65, 127, 256, 511 };
+			static constexpr int NumSizes = static_cast<int>(sizeof(Sizes) / sizeof(Sizes[0]));
+			std::vector<int> sizes;
+			while (numSamples > 0)
+			{
+				const auto size = std::min(Sizes[rand.nextInt(NumSizes)], numSamples);
+				sizes.push_back(size);
+				numSamples -= size;
+			}
+			return sizes;
+		}
+		static int getMaxBlockSize(const std::vector<int>& sizes)
+		{
+			return *std::max_element(sizes.begin(), sizes.end());
+		}
+		static int makeNumChannels(juce::Random& rand)
+		{
+			return 1 + rand.nextInt(MaxNumChannels);
+		}
+		/* white noise in [-1, 1) */
+		static std::vector<float> makeSignal(juce::Random& rand, int numSamples)
+		{
+			std::vector<float> signal(numSamples);
+			for (auto& s : signal)
+				s = rand.nextFloat() * 2.f - 1.f;
+			return signal;
+		}
+		/* random taps with a sum of magnitudes of 1, so the output stays within the input's range */
+		static oversampling::Buffer makeTaps(juce::Random& rand)
+		{
+			oversampling::Buffer taps(1 + rand.nextInt(160));
+			auto sum = 0.f;
+			for (auto& t : taps)
+			{
+				t = rand.nextFloat() * 2.f - 1.f;
+				sum += std::abs(t);
+			}
+			for (auto& t : taps)
+				t /= sum;
+			return taps;
+		}
+		static double convolve(const oversampling::Buffer& taps, const std::vector<float>& x, int s) noexcept
+		{
+			auto y = 0.;
+			for (auto k = 0; k < static_cast<int>(taps.size()) && k <= s; ++k)
+				y += static_cast<double>(taps[k]) * static_cast<double>(x[s - k]);
+			return y;
+		}
+
+		void checkConvolution(Report& report)
+		{
+			const Tolerance tolerance{ 1e-5, 256. };
+
+			check(report, "Convolution down", tolerance, [](juce::Random& rand, ISA, Measurement& m)
+			{
+				const auto taps = makeTaps(rand);
+				const auto numChannels = makeNumChannels(rand);
+				const auto sizes = makeBlockSizes(rand, NumSamplesPerRun);
+				oversampling::ConvolutionFilter filter(numChannels, taps);
+				std::vector<std::vector<float>> signals;
+				for (auto ch = 0; ch < numChannels; ++ch)
+					signals.push_back(makeSignal(rand, NumSamplesPerRun));
+				auto y = signals;
+				std::vector<float*> samples(numChannels);
+				auto s0 = 0;
+				for (const auto n : sizes)
+				{
+					for (auto ch = 0; ch < numChannels; ++ch)
+						samples[ch] = y[ch].data() + s0;
+					time(m, n * numChannels, [&]() { filter.processBlockDown(samples.data(), numChannels, n); });
+					s0 += n;
+				}
+				for (auto ch = 0; ch < numChannels; ++ch)
+					for (auto s = 0; s < NumSamplesPerRun; ++s)
+						m.error.add(y[ch][s], convolve(taps, signals[ch], s));
+			});
+
+			/* inputs on the even samples, zeros in between, like Stage::upsample stuffs them */
+			const auto makeStuffed = [](juce::Random& rand)
+			{
+				auto x = makeSignal(rand, NumSamplesPerRun);
+				for (auto s = 1; s < NumSamplesPerRun; s += 2)
+					x[s] = 0.f;
+				return x;
+			};
+
+			check(report, "Convolution up", tolerance, [makeStuffed](juce::Random& rand, ISA, Measurement& m)
+			{
+				const auto taps = makeTaps(rand);
+				const auto numChannels = makeNumChannels(rand);
+				const auto sizes = makeBlockSizes(rand, NumSamplesPerRun / 2);
+				oversampling::ConvolutionFilter filter(numChannels, taps);
+				std::vector<std::vector<float>> signals;
+				for (auto ch = 0; ch < numChannels; ++ch)
+					signals.push_back(makeStuffed(rand));
+				auto y = signals;
+				std::vector<float*> samples(numChannels);
+				auto s0 = 0;
+				for (const auto n : sizes)
+				{
+					for (auto ch = 0; ch < numChannels; ++ch)
+						samples[ch] = y[ch].data() + s0;
+					time(m, n * 2 * numChannels, [&]() { filter.processBlockUp(samples.data(), numChannels, n * 2); });
+					s0 += n * 2;
+				}
+				for (auto ch = 0; ch < numChannels; ++ch)
+					for (auto s = 0; s < NumSamplesPerRun; ++s)
+						m.error.add(y[ch][s], convolve(taps, signals[ch], s));
+			});
+
+			check(report, "Convolution up per sample", tolerance, [makeStuffed](juce::Random& rand, ISA, Measurement& m)
+			{
+				const auto taps = makeTaps(rand);
+				const auto numChannels = makeNumChannels(rand);
+				oversampling::ConvolutionFilter filter(numChannels, taps);
+				for (auto ch = 0; ch < numChannels; ++ch)
+				{
+					const auto x = makeStuffed(rand);
+					auto y = x;
+					time(m, NumSamplesPerRun, [&]()
+					{
+						for (auto s = 0; s < NumSamplesPerRun; s += 2)
+						{
+							y[s] = filter.processSampleUpEven(x[s], ch);
+							y[s + 1] = filter.processSampleUpOdd(ch);
+						}
+					});
+					for (auto s = 0; s < NumSamplesPerRun; ++s)
+						m.error.add(y[s], convolve(taps, x, s));
+				}
+			});
+		}
+
+		/* the interpolators as halfband firs, see PolynomialFilter */
+		template<int NumPoints>
+		static oversampling::Buffer makeHalfband()
+		{
+			oversampling::Buffer taps(2 * NumPoints - 1, 0.f);
+			for (auto p = 0; p < NumPoints; ++p)
+				taps[p * 2] = oversampling::Midpoint<NumPoints>::Weights[p];
+			taps[NumPoints - 1] = 1.f;
+			return taps;
+		}
+
+		void checkPolynomial(Report& report)
+		{
+			const auto checkPoints = [&](const juce::String& name, int numPoints, const oversampling::Buffer& taps)
+			{
+				check(report, name + " up", { 1e-6, 32. }, [numPoints, taps](juce::Random& rand, ISA, Measurement& m)
+				{
+					const auto numChannels = makeNumChannels(rand);
+					const auto sizes = makeBlockSizes(rand, NumSamplesPerRun / 2);
+					oversampling::PolynomialFilter filter(numChannels, numPoints);
+					std::vector<std::vector<float>> signals, y;
+					for (auto ch = 0; ch < numChannels; ++ch)
+					{
+						signals.push_back(makeSignal(rand, NumSamplesPerRun / 2));
+						y.emplace_back(NumSamplesPerRun, 0.f);
+					}
+					juce::AudioBuffer<float> buffer(numChannels, getMaxBlockSize(sizes) * 2);
+					auto s0 = 0;
+					for (const auto n : sizes)
+					{
+						for (auto ch = 0; ch < numChannels; ++ch)
+							buffer.copyFrom(ch, 0, signals[ch].data() + s0, n);
+						time(m, n * 2 * numChannels, [&]() { filter.upsample(buffer.getArrayOfWritePointers(), numChannels, n); });
+						for (auto ch = 0; ch < numChannels; ++ch)
+							std::copy(buffer.getReadPointer(ch), buffer.getReadPointer(ch) + n * 2, y[ch].begin() + s0 * 2);
+						s0 += n;
+					}
+					for (auto ch = 0; ch < numChannels; ++ch)
+					{
+						std::vector<float> stuffed(NumSamplesPerRun, 0.f);
+						for (auto s = 0; s < NumSamplesPerRun / 2; ++s)
+							stuffed[s * 2] = signals[ch][s];
+						for (auto s = 0; s < NumSamplesPerRun; ++s)
+							m.error.add(y[ch][s], convolve(taps, stuffed, s));
+					}
+				});
+
+				check(report, name + " down", { 1e-6, 32. }, [numPoints, taps](juce::Random& rand, ISA, Measurement& m)
+				{
+					auto halved = taps;
+					for (auto& t : halved)
+						t *= .5f;
+					const auto numChannels = makeNumChannels(rand);
+					const auto sizes = makeBlockSizes(rand, NumSamplesPerRun / 2);
+					oversampling::PolynomialFilter filter(numChannels, numPoints);
+					std::vector<std::vector<float>> signals;
+					for (auto ch = 0; ch < numChannels; ++ch)
+						signals.push_back(makeSignal(rand, NumSamplesPerRun));
+					auto y = signals;
+					std::vector<float*> samples(numChannels);
+					auto s0 = 0;
+					for (const auto n : sizes)
+					{
+						for (auto ch = 0; ch < numChannels; ++ch)
+							samples[ch] = y[ch].data() + s0 * 2;
+						time(m, n * 2 * numChannels, [&]() { filter.downsample(samples.data(), numChannels, n * 2); });
+						for (auto ch = 0; ch < numChannels; ++ch)
+							std::copy(samples[ch], samples[ch] + n, y[ch].begin() + s0);
+						s0 += n;
+					}
+					for (auto ch = 0; ch < numChannels; ++ch)
+						for (auto s = 0; s < NumSamplesPerRun / 2; ++s)
+							m.error.add(y[ch][s], convolve(halved, signals[ch], s * 2));
+				});
+			};
+			checkPoints("Hermite", 4, makeHalfband<4>());
+			checkPoints("Lagrange", 6, makeHalfband<6>());
+		}
+
+		void checkIIR(Report& report)
+		{
+			check(report, "Chebyshev IIR", ChebyshevTolerance, [](juce::Random& rand, ISA, Measurement& m)
+			{
+				const auto numChannels = makeNumChannels(rand);
+				const auto sizes = makeBlockSizes(rand, NumSamplesPerRun);
+				for (auto ch = 0; ch < numChannels; ++ch)
+				{
+					oversampling::LowkeyChebyshevFilter<float> filter(numChannels);
+					const auto x = makeSignal(rand, NumSamplesPerRun);
+					baseline::IIR reference;
+					reference.makeChebyshev_lp_4pole_fc45_ripl5();
+					auto y = x;
+					auto yRef = x;
+					for (auto& s : yRef)
+						s = reference.processSample(s);
+
+					// the other channels get the same signal, only this one is compared
+					std::vector<std::vector<float>> others(numChannels);
+					std::vector<float*> samples(numChannels);
+					auto s0 = 0;
+					for (const auto n : sizes)
+					{
+						for (auto c = 0; c < numChannels; ++c)
+						{
+							others[c].assign(x.begin() + s0, x.begin() + s0 + n);
+							samples[c] = c == ch ? y.data() + s0 : others[c].data();
+						}
+						time(m, n * numChannels, [&]() { filter.processBlock(samples.data(), numChannels, n); });
+						s0 += n;
+					}
+					m.error.add(y.data(), yRef.data(), NumSamplesPerRun);
+				}
+			});
+		}
+
+		/*
+		* the stages of a config, 2x at a time, out of the frozen scalar filters in Baseline.h.
+		* polynomial stages are their halfband firs, see checkPolynomial
+		*/
+		struct ReferenceChain
+		{
+			ReferenceChain(const oversampling::Config& _config, int _numChannels) :
+				config(_config),
+				firsUp(), firsDown(), iirsUp(), iirsDown(),
+				numChannels(_numChannels)
+			{
+				for (auto st = 0; st < config.numStages; ++st)
+				{
+					const auto& spec = config.stages[st];
+					baseline::Buffer up, down;
+					switch (spec.type)
+					{
+					case oversampling::FilterType::FIR:
+						up = toBuffer(oversampling::makeStageFilter(spec, true));
+						down = toBuffer(oversampling::makeStageFilter(spec, false));
+						break;
+					case oversampling::FilterType::Hermite: up = makeHalfband<4>(); break;
+					case oversampling::FilterType::Lagrange: up = makeHalfband<6>(); break;
+					default: break;
+					}
+					if (spec.type != oversampling::FilterType::FIR)
+					{
+						down = up;
+						for (auto& t : down)
+							t *= .5f;
+					}
+					firsUp.emplace_back(numChannels, up);
+					firsDown.emplace_back(numChannels, down);
+					iirsUp.emplace_back(numChannels);
+					iirsDown.emplace_back(numChannels);
+				}
+			}
+			/* samples must have room for numSamples * 2^numStages */
+			void process(float** samples, int numSamples) noexcept
+			{
+				for (auto st = 0; st < config.numStages; ++st)
+				{
+					const auto isIIR = config.stages[st].type == oversampling::FilterType::IIR;
+					// the iir has unity gain, so the stuffing makes up for the lost energy
+					const auto gain = isIIR ? 2.f : 1.f;
+					for (auto ch = 0; ch < numChannels; ++ch)
+						for (auto s = numSamples - 1; s > -1; --s)
+						{
+							samples[ch][s * 2] = samples[ch][s] * gain;
+							samples[ch][s * 2 + 1] = 0.f;
+						}
+					numSamples *= 2;
+					if (isIIR)
+						iirsUp[st].processBlock(samples, numSamples);
+					else
+						firsUp[st].processBlockUp(samples, numSamples);
+				}
+				for (auto st = config.numStages - 1; st > -1; --st)
+				{
+					if (config.stages[st].type == oversampling::FilterType::IIR)
+						iirsDown[st].processBlock(samples, numSamples);
+					else
+						firsDown[st].processBlockDown(samples, numSamples);
+					numSamples /= 2;
+					for (auto ch = 0; ch < numChannels; ++ch)
+						for (auto s = 0; s < numSamples; ++s)
+							samples[ch][s] = samples[ch][s * 2];
+				}
+			}
+		protected:
+			oversampling::Config config;
+			std::vector<baseline::ConvolutionFilter> firsUp, firsDown;
+			std::vector<baseline::LowkeyChebyshevFilter> iirsUp, iirsDown;
+			int numChannels;
+
+			static baseline::Buffer toBuffer(const oversampling::ImpulseResponse& ir)
+			{
+				return baseline::Buffer(ir.getData(), ir.getData() + ir.size());
+			}
+		};
+
+		/* up- and downsampling through all stages of a config */
+		void checkStages(Report& report)
+		{
+			/* realtime is the baseline's chain, so it's compared to the baseline's Processor itself */
+			using Reference = std::function<void(float** samples, int numSamples)>;
+			using MakeReference = std::function<Reference(int numChannels)>;
+
+			const auto checkConfig = [&](const juce::String& name, const oversampling::Config& config, const Tolerance& tolerance, const MakeReference& makeReference)
+			{
+				check(report, name, tolerance, [config, makeReference](juce::Random& rand, ISA, Measurement& m)
+				{
+					const auto numChannels = makeNumChannels(rand);
+					const auto sizes = makeBlockSizes(rand, NumSamplesPerRun);
+					const auto maxBlockSize = getMaxBlockSize(sizes) * static_cast<int>(oversampling::MaxOrder);
+					std::vector<oversampling::Stage> stages;
+					for (auto st = 0; st < config.numStages; ++st)
+						stages.emplace_back(numChannels, config.stages[st]);
+					auto reference = makeReference(numChannels);
+					std::vector<std::vector<float>> signals;
+					for (auto ch = 0; ch < numChannels; ++ch)
+						signals.push_back(makeSignal(rand, NumSamplesPerRun));
+
+					juce::AudioBuffer<float> y(numChannels, maxBlockSize), yRef(numChannels, maxBlockSize);
+					const auto process = [&config, &stages, numChannels](float** samples, int n)
+					{
+						auto numSamples = n;
+						for (auto& stage : stages)
+						{
+							stage.upsample(samples, numChannels, numSamples);
+							numSamples *= 2;
+						}
+						for (auto st = config.numStages - 1; st > -1; --st)
+						{
+							stages[st].downsample(samples, numChannels, numSamples);
+							numSamples /= 2;
+						}
+					};
+					auto s0 = 0;
+					for (const auto n : sizes)
+					{
+						for (auto ch = 0; ch < numChannels; ++ch)
+						{
+							y.copyFrom(ch, 0, signals[ch].data() + s0, n);
+							yRef.copyFrom(ch, 0, signals[ch].data() + s0, n);
+						}
+						reference(yRef.getArrayOfWritePointers(), n);
+						time(m, n * numChannels, [&]() { process(y.getArrayOfWritePointers(), n); });
+						for (auto ch = 0; ch < numChannels; ++ch)
+							m.error.add(y.getReadPointer(ch), yRef.getReadPointer(ch), n);
+						s0 += n;
+					}
+				});
+			};
+			const auto makeChain = [](const oversampling::Config& config)
+			{
+				return [config](int numChannels)
+				{
+					auto chain = std::make_shared<ReferenceChain>(config, numChannels);
+					return Reference([chain](float** samples, int n) { chain->process(samples, n); });
+				};
+			};
+			checkConfig("Stages realtime", oversampling::makeRealtimeConfig(), ChebyshevTolerance, [](int numChannels)
+			{
+				auto processor = std::make_shared<baseline::Processor>(numChannels);
+				return Reference([processor](float** samples, int n)
+				{
+					processor->upsample(samples, n);
+					processor->downsample(samples);
+				});
+			});
+			checkConfig("Stages offline", oversampling::makeOfflineConfig(), { 1e-5, 256. }, makeChain(oversampling::makeOfflineConfig()));
+			checkConfig("Stages draft", oversampling::makeDraftConfig(), { 1e-5, 256. }, makeChain(oversampling::makeDraftConfig()));
+		}
+
+		void checkNonLinear(Report& report)
+		{
+			/*
+			* the folded value jumps at the edges of the wrap, a rounding difference there picks the other edge.
+			* samples driven to within Epsilon of an edge aren't compared
+			*/
+			static constexpr double Epsilon = 1e-5;
+			const auto fold = [](float x, double drive, Error& error, float y)
+			{
+				const auto v = static_cast<double>(x) * drive * .5 + .5;
+				if (std::abs(v - std::round(v)) < Epsilon)
+					return;
+				auto w = v - std::floor(v);
+				if (w == 0. && v > 0.)
+					w = 1.;
+				error.add(y, (w * 2. - 1.) / drive);
+			};
+
+			check(report, "Wavefolder", { 1e-5, 256. }, [fold](juce::Random& rand, ISA, Measurement& m)
+			{
+				const auto numChannels = makeNumChannels(rand);
+				const auto sizes = makeBlockSizes(rand, NumSamplesPerRun);
+				const auto drive = 1.f + rand.nextFloat() * 15.f;
+				dsp::Wavefolder wavefolder;
+				wavefolder.setDrive(drive);
+				for (const auto n : sizes)
+				{
+					juce::AudioBuffer<float> buffer(numChannels, n);
+					for (auto ch = 0; ch < numChannels; ++ch)
+						buffer.copyFrom(ch, 0, makeSignal(rand, n).data(), n);
+					juce::AudioBuffer<float> x(buffer);
+					time(m, n * numChannels, [&]() { wavefolder.processBlock(buffer); });
+					for (auto ch = 0; ch < numChannels; ++ch)
+						for (auto s = 0; s < n; ++s)
+							fold(x.getSample(ch, s), static_cast<double>(drive), m.error, buffer.getSample(ch, s));
+				}
+			});
+
+			check(report, "Wavefolder smooth", { 1e-5, 256. }, [fold](juce::Random& rand, ISA, Measurement& m)
+			{
+				const auto numChannels = makeNumChannels(rand);
+				const auto sizes = makeBlockSizes(rand, NumSamplesPerRun);
+				dsp::Wavefolder wavefolder;
+				for (const auto n : sizes)
+				{
+					juce::AudioBuffer<float> buffer(numChannels, n);
+					for (auto ch = 0; ch < numChannels; ++ch)
+						buffer.copyFrom(ch, 0, makeSignal(rand, n).data(), n);
+					juce::AudioBuffer<float> x(buffer);
+					std::vector<float> drive(n);
+					for (auto& d : drive)
+						d = 1.f + rand.nextFloat() * 15.f;
+					time(m, n * numChannels, [&]() { wavefolder.processBlock(buffer, drive.data()); });
+					for (auto ch = 0; ch < numChannels; ++ch)
+						for (auto s = 0; s < n; ++s)
+							fold(x.getSample(ch, s), static_cast<double>(drive[s]), m.error, buffer.getSample(ch, s));
+				}
+			});
+
+			const auto saturate = [](float x, double drive)
+			{
+				const auto xD = static_cast<double>(x);
+				const auto shaped = xD > 0. ? std::sqrt(std::sqrt(xD)) : -std::sqrt(std::sqrt(-xD));
+				return xD + drive * (shaped - xD);
+			};
+
+			check(report, "Saturator", { 1e-6, 16. }, [saturate](juce::Random& rand, ISA, Measurement& m)
+			{
+				const auto numChannels = makeNumChannels(rand);
+				const auto sizes = makeBlockSizes(rand, NumSamplesPerRun);
+				const auto drive = rand.nextFloat();
+				dsp::Saturator saturator;
+				saturator.setDrive(drive);
+				for (const auto n : sizes)
+				{
+					juce::AudioBuffer<float> buffer(numChannels, n);
+					for (auto ch = 0; ch < numChannels; ++ch)
+						buffer.copyFrom(ch, 0, makeSignal(rand, n).data(), n);
+					juce::AudioBuffer<float> x(buffer);
+					time(m, n * numChannels, [&]() { saturator.processBlock(buffer); });
+					for (auto ch = 0; ch < numChannels; ++ch)
+						for (auto s = 0; s < n; ++s)
+							m.error.add(buffer.getSample(ch, s), saturate(x.getSample(ch, s), static_cast<double>(drive)));
+				}
+			});
+
+			check(report, "Saturator smooth", { 1e-6, 16. }, [saturate](juce::Random& rand, ISA, Measurement& m)
+			{
+				const auto numChannels = makeNumChannels(rand);
+				const auto sizes = makeBlockSizes(rand, NumSamplesPerRun);
+				dsp::Saturator saturator;
+				for (const auto n : sizes)
+				{
+					juce::AudioBuffer<float> buffer(numChannels, n);
+					for (auto ch = 0; ch < numChannels; ++ch)
+						buffer.copyFrom(ch, 0, makeSignal(rand, n).data(), n);
+					juce::AudioBuffer<float> x(buffer);
+					std::vector<float> drive(n);
+					for (auto& d : drive)
+						d = rand.nextFloat();
+					time(m, n * numChannels, [&]() { saturator.processBlock(buffer, drive.data()); });
+					for (auto ch = 0; ch < numChannels; ++ch)
+						for (auto s = 0; s < n; ++s)
+							m.error.add(buffer.getSample(ch, s), saturate(x.getSample(ch, s), static_cast<double>(drive[s])));
+				}
+			});
+
+			const auto checkVibrato = [&](const juce::String& name, dsp::Interpolation interpolation)
+			{
+				check(report, name, { 1e-5, 256. }, [interpolation](juce::Random& rand, ISA, Measurement& m)
+				{
+					const auto sizes = makeBlockSizes(rand, NumSamplesPerRun);
+					const auto frequency = .1f + rand.nextFloat() * 8.f;
+					const auto depth = rand.nextFloat();
+					dsp::Vibrato vibrato;
+					baseline::Vibrato reference;
+					vibrato.prepareToPlay(44100., getMaxBlockSize(sizes));
+					reference.prepareToPlay(44100., getMaxBlockSize(sizes));
+					vibrato.setFrequency(frequency);
+					reference.setFrequency(frequency);
+					vibrato.setDepth(depth);
+					reference.setDepth(depth);
+					vibrato.setInterpolation(interpolation);
+					reference.setInterpolation(interpolation);
+					const auto x = makeSignal(rand, NumSamplesPerRun);
+					auto y = x;
+					auto yRef = x;
+					auto s0 = 0;
+					for (const auto n : sizes)
+					{
+						reference.process(yRef.data() + s0, n);
+						time(m, n, [&]() { vibrato.process(y.data() + s0, n); });
+						s0 += n;
+					}
+					m.error.add(y.data(), yRef.data(), NumSamplesPerRun);
+				});
+			};
+			checkVibrato("Vibrato linear", dsp::Interpolation::Linear);
+			checkVibrato("Vibrato cubic", dsp::Interpolation::Cubic);
+			checkVibrato("Vibrato lagrange", dsp::Interpolation::Lagrange);
+			checkVibrato("Vibrato allpass", dsp::Interpolation::Allpass);
+		}
+	};
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+
+namespace governor
+{
+	/*
+	* from best to cheapest.
+	* Reduced only switches the vibrato to linear interpolation so far,
+	* shorter oversampling filters and a lower oversampling factor for it are still to do
+	*/
+	enum class Tier { Full, Reduced, BaseRate, NumTiers };
+	static constexpr int NumTiers = static_cast<int>(Tier::NumTiers);
+
+	inline juce::String toString(Tier t)
+	{
+		switch (t)
+		{
+		case Tier::Full: return "Full";
+		case Tier::Reduced: return "Reduced";
+		case Tier::BaseRate: return "Base Rate";
+		default: return "";
+		}
+	}
+
+	static constexpr int WindowSize = 64; // blocks
+	static constexpr float Percentile = .95f;
+	static constexpr float HighLoad = .7f; // of the block's deadline
+	static constexpr float LowLoad = .3f;
+	static constexpr int UpHoldBlocks = WindowSize * 8;
+
+	/*
+	* measures how long the audio callback takes compared to the block's deadline.
+	* steps one tier down as soon as the high percentile of the last WindowSize blocks exceeds HighLoad,
+	* steps back up only after it stayed below LowLoad for UpHoldBlocks.
+	* after every step a whole window is measured again before the next decision.
+	* everything but getTier() runs on the audio thread.
+	*/
+	struct Governor
+	{
+		Governor() :
+			loads(),
+			sorted(),
+			tier(0),
+			secondsPerTick(1. / static_cast<double>(juce::Time::getHighResolutionTicksPerSecond())),
+			Fs(44100.),
+			start(0),
+			writeIdx(0), numMeasured(0), lowBlocks(0)
+		{
+			loads.fill(0.f);
+		}
+
+		void prepareToPlay(double sampleRate) noexcept
+		{
+			Fs = sampleRate;
+			loads.fill(0.f);
+			writeIdx = numMeasured = lowBlocks = 0;
+		}
+
+		void begin() noexcept { start = juce::Time::getHighResolutionTicks(); }
+		void end(int numSamples) noexcept
+		{
+			if (numSamples == 0)
+				return;
+			const auto seconds = static_cast<double>(juce::Time::getHighResolutionTicks() - start) * secondsPerTick;
+			loads[writeIdx] = static_cast<float>(seconds * Fs / static_cast<double>(numSamples));
+			writeIdx = (writeIdx + 1) % WindowSize;
+			// stays at WindowSize while the tier is stable, every block is a decision from there on
+			numMeasured = std::min(numMeasured + 1, WindowSize);
+			if (numMeasured < WindowSize)
+				return;
+
+			sorted = loads;
+			const auto pIdx = static_cast<int>(Percentile * static_cast<float>(WindowSize - 1));
+			std::nth_element(sorted.begin(), sorted.begin() + pIdx, sorted.end());
+			const auto load = sorted[pIdx];
+
+			const auto t = tier.load();
+			if (load > HighLoad)
+			{
+				lowBlocks = 0;
+				if (t < NumTiers - 1)
+					step(t + 1);
+			}
+			else if (load < LowLoad && t > 0)
+			{
+				if (++lowBlocks >= UpHoldBlocks)
+					step(t - 1);
+			}
+			else
+				lowBlocks = 0;
+		}
+
+		/* any thread */
+		Tier getTier() const noexcept { return static_cast<Tier>(tier.load()); }
+		/* for testing or to pin the quality, any thread */
+		void setTier(Tier t) noexcept { tier.store(static_cast<int>(t)); }
+	protected:
+		std::array<float, WindowSize> loads, sorted;
+		std::atomic<int> tier;
+		double secondsPerTick, Fs;
+		juce::int64 start;
+		int writeIdx, numMeasured, lowBlocks;
+
+		void step(int t) noexcept
+		{
+			tier.store(t);
+			numMeasured = lowBlocks = 0;
+		}
+	};
+}
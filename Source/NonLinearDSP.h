@@ -17,7 +17,7 @@ namespace dsp {
 		void setFrequency(float f) { inc = f * fsInv; }
 		float process() noexcept {
 			phase += inc;
-			while (phase >= 1.f)
+			if (phase >= 1.f)
 				phase -= 2.f;
 			return phase;
 		}
@@ -25,34 +25,131 @@ namespace dsp {
 		float fsInv, phase, inc;
 	};
 
+	/*
+	* sin(pi * x) for x in [-1, 1)
+	* folds x into [-.5, .5] and evaluates a minimax polynomial (max error < 1e-6)
+	*/
+	inline float sinPi(float x) noexcept
+	{
+		x = std::copysign(.5f - std::abs(std::abs(x) - .5f), x);
+		const auto xx = x * x;
+		return x * (3.14158202f + xx * (-5.16714273f + xx * (2.54189841f + xx * -.55463455f)));
+	}
+
 	struct SineOsc {
 		SineOsc() :
 			phasor()
 		{}
 		void prepareToPlay(double sampleRate) { phasor.prepareToPlay(sampleRate); }
 		void setFrequency(float f) { phasor.setFrequency(f); }
-		float process() noexcept { return std::sin(phasor.process() * pi); }
+		float process() noexcept { return sinPi(phasor.process()); }
 	protected:
 		Phasor phasor;
 	};
 
+	/*
+	* sine oscillators for up to MaxLanes channels or voices.
+	* each lane is a complex phasor that gets rotated once per sample,
+	* the lanes are stored next to each other so that the rotation vectorizes.
+	* the phasors are renormalized every RenormInterval samples to stop them from drifting.
+	*/
+	struct OscBank
+	{
+		static constexpr int MaxLanes = 8;
+		static constexpr int RenormInterval = 256;
+		using Lanes = std::array<float, MaxLanes>;
+
+		OscBank(int _numLanes = 1) :
+			re(), im(), rotRe(), rotIm(),
+			fsInv(0.f),
+			numLanes(std::min(_numLanes, MaxLanes))
+		{
+			re.fill(1.f);
+			im.fill(0.f);
+			rotRe.fill(1.f);
+			rotIm.fill(0.f);
+		}
+		void prepareToPlay(double sampleRate)
+		{
+			fsInv = static_cast<float>(1. / sampleRate);
+			re.fill(1.f);
+			im.fill(0.f);
+		}
+		void setFrequency(float f) noexcept
+		{
+			for (auto l = 0; l < numLanes; ++l)
+				setFrequency(l, f);
+		}
+		void setFrequency(int lane, float f) noexcept
+		{
+			const auto w = tau * f * fsInv;
+			rotRe[lane] = std::cos(w);
+			rotIm[lane] = std::sin(w);
+		}
+		/* writes numSamples of each lane's sine into out[lane] */
+		void fillBlock(float* const* out, int numSamples) noexcept
+		{
+			for (auto s0 = 0; s0 < numSamples; s0 += RenormInterval)
+			{
+				const auto s1 = std::min(s0 + RenormInterval, numSamples);
+				for (auto s = s0; s < s1; ++s)
+				{
+					for (auto l = 0; l < MaxLanes; ++l)
+					{
+						const auto r = re[l] * rotRe[l] - im[l] * rotIm[l];
+						const auto i = im[l] * rotRe[l] + re[l] * rotIm[l];
+						re[l] = r;
+						im[l] = i;
+					}
+					for (auto l = 0; l < numLanes; ++l)
+						out[l][s] = im[l];
+				}
+				renormalize();
+			}
+		}
+		int getNumLanes() const noexcept { return numLanes; }
+	protected:
+		Lanes re, im, rotRe, rotIm;
+		float fsInv;
+		int numLanes;
+
+		void renormalize() noexcept
+		{ // 1st order newton step towards |z| = 1
+			for (auto l = 0; l < MaxLanes; ++l)
+			{
+				const auto g = 1.5f - .5f * (re[l] * re[l] + im[l] * im[l]);
+				re[l] *= g;
+				im[l] *= g;
+			}
+		}
+	};
+
 	struct RingMod
 	{
 		RingMod(int numChannels) :
-			lfo()
+			lfo(numChannels),
+			lfoBuffer()
 		{
-			lfo.resize(numChannels);
 		}
-		void prepareToPlay(double sampleRate) { for (auto& l : lfo) l.prepareToPlay(sampleRate); }
-		void setFrequency(float f) { for (auto& l : lfo) l.setFrequency(f); }
+		void prepareToPlay(double sampleRate, int blockSize)
+		{
+			lfo.prepareToPlay(sampleRate);
+			lfoBuffer.setSize(lfo.getNumLanes(), blockSize, false, false, false);
+		}
+		void setFrequency(float f) { lfo.setFrequency(f); }
 		void processBlock(juce::AudioBuffer<float>& buffer) noexcept {
+			const auto numChannels = std::min(buffer.getNumChannels(), lfo.getNumLanes());
+			const auto numSamples = buffer.getNumSamples();
+			lfoBuffer.setSize(lfo.getNumLanes(), numSamples, true, false, true);
+			auto lfoSamples = lfoBuffer.getArrayOfWritePointers();
+			lfo.fillBlock(lfoSamples, numSamples);
 			auto samples = buffer.getArrayOfWritePointers();
-			for (auto ch = 0; ch < buffer.getNumChannels(); ++ch)
-				for (auto s = 0; s < buffer.getNumSamples(); ++s)
-					samples[ch][s] *= lfo[ch].process();
+			for (auto ch = 0; ch < numChannels; ++ch)
+				juce::FloatVectorOperations::multiply(samples[ch], lfoSamples[ch], numSamples);
 		}
 	protected:
-		std::vector<SineOsc> lfo;
+		OscBank lfo;
+		juce::AudioBuffer<float> lfoBuffer;
 	};
 
 	struct Wavefolder {
@@ -66,25 +163,41 @@ namespace dsp {
 			driveHalf = d * .5f;
 			driveInv = 1.f / drive;
 		}
+		/* nothing gets folded as long as the driven peak stays within [-1, 1] */
+		static bool isTransparent(float drive, float peak) noexcept { return drive * peak <= 1.f; }
 		void processBlock(juce::AudioBuffer<float>& buffer) {
 			const auto num = buffer.getNumSamples();
-			for (auto ch = 0; ch < buffer.getNumChannels(); ++ch) {
-				auto samples = buffer.getWritePointer(ch);
-				juce::FloatVectorOperations::multiply(samples, driveHalf, num);
-				juce::FloatVectorOperations::add(samples, .5f, num);
-				for (auto s = 0; s < num; ++s) {
-					while (samples[s] > 1.f)
-						--samples[s];
-					while (samples[s] < 0.f)
-						++samples[s];
-				}
-				juce::FloatVectorOperations::multiply(samples, 2.f, num);
-				juce::FloatVectorOperations::add(samples, -1.f, num);
-				juce::FloatVectorOperations::multiply(samples, driveInv, num);
-			}
+			const auto process = oversampling::Dispatched<&fold>::get();
+			for (auto ch = 0; ch < buffer.getNumChannels(); ++ch)
+				process(buffer.getWritePointer(ch), num, driveHalf, driveInv);
+		}
+		/* drive given per sample, for when it is being smoothed */
+		void processBlock(juce::AudioBuffer<float>& buffer, const float* driveBuf) {
+			const auto num = buffer.getNumSamples();
+			const auto process = oversampling::Dispatched<&foldSmooth>::get();
+			for (auto ch = 0; ch < buffer.getNumChannels(); ++ch)
+				process(buffer.getWritePointer(ch), driveBuf, num);
+			setDrive(driveBuf[num - 1]);
 		}
 	protected:
 		float drive, driveHalf, driveInv;
+
+		/* wraps x into [0, 1] like adding or subtracting 1 until it's inside would, but without branches */
+		static float wrap(float x) noexcept
+		{
+			const auto f = x - std::floor(x);
+			return f == 0.f && x > 0.f ? 1.f : f;
+		}
+		static void fold(float* samples, int num, float dHalf, float dInv) noexcept
+		{
+			for (auto s = 0; s < num; ++s)
+				samples[s] = (wrap(samples[s] * dHalf + .5f) * 2.f - 1.f) * dInv;
+		}
+		static void foldSmooth(float* samples, const float* driveBuf, int num) noexcept
+		{
+			for (auto s = 0; s < num; ++s)
+				samples[s] = (wrap(samples[s] * driveBuf[s] * .5f + .5f) * 2.f - 1.f) / driveBuf[s];
+		}
 	};
 
 	struct Saturator
@@ -93,68 +206,198 @@ namespace dsp {
 			drive(0.f)
 		{}
 		void setDrive(float d) noexcept { drive = d; }
+		/* below this drive the residual stays under -86dB */
+		static constexpr float TransparentDrive = 1e-4f;
+		static bool isTransparent(float drive, float peak) noexcept { return drive < TransparentDrive || peak == 0.f; }
 		void processBlock(juce::AudioBuffer<float>& buffer) {
 			const auto num = buffer.getNumSamples();
-			for (auto ch = 0; ch < buffer.getNumChannels(); ++ch) {
-				auto samples = buffer.getWritePointer(ch);
-				for (auto s = 0; s < num; ++s) {
-					const auto p = samples[s] > 0.f ? 1.f : -1.f;
-					const auto b = p * std::sqrt(p * samples[s]);
-					const auto c = p * std::sqrt(p * b);
-					samples[s] += drive * (c - samples[s]);
-				}
-			}
+			const auto process = oversampling::Dispatched<&saturate>::get();
+			for (auto ch = 0; ch < buffer.getNumChannels(); ++ch)
+				process(buffer.getWritePointer(ch), num, drive);
+		}
+		/* drive given per sample, for when it is being smoothed */
+		void processBlock(juce::AudioBuffer<float>& buffer, const float* driveBuf) {
+			const auto num = buffer.getNumSamples();
+			const auto process = oversampling::Dispatched<&saturateSmooth>::get();
+			for (auto ch = 0; ch < buffer.getNumChannels(); ++ch)
+				process(buffer.getWritePointer(ch), driveBuf, num);
+			setDrive(driveBuf[num - 1]);
 		}
 	protected:
 		float drive;
+
+		/* 4th root, keeps the sign */
+		static float shape(float x) noexcept
+		{
+			const auto p = x > 0.f ? 1.f : -1.f;
+			const auto b = p * std::sqrt(p * x);
+			return p * std::sqrt(p * b);
+		}
+		static void saturate(float* samples, int num, float d) noexcept
+		{
+			for (auto s = 0; s < num; ++s)
+				samples[s] += d * (shape(samples[s]) - samples[s]);
+		}
+		static void saturateSmooth(float* samples, const float* driveBuf, int num) noexcept
+		{
+			for (auto s = 0; s < num; ++s)
+				samples[s] += driveBuf[s] * (shape(samples[s]) - samples[s]);
+		}
 	};
 
+	enum class Interpolation { Linear, Cubic, Lagrange, Allpass };
+
+	/*
+	* modulated delay line.
+	* the lfo runs at control rate and the delay time is ramped linearly in between.
+	* the ring buffer has a power of 2 length and is mirrored, so that
+	* all 4 taps of an interpolator can be read without wrapping around.
+	*/
 	struct Vibrato
 	{
+		static constexpr int ControlRate = 32; // samples per lfo tick
+
 		Vibrato() :
 			lfo(),
 			ringBuffer(),
+			interpolation(Interpolation::Cubic),
 			depth(1.f),
-			writeHead(0),
-			size(0)
+			delay(0.f), delayInc(0.f), apState(0.f),
+			writeHead(0), size(0), mask(0), controlIdx(0)
 		{
 		}
 		void prepareToPlay(double sampleRate, int blockSize) {
 			size = static_cast<int>(sampleRate * 7. / 1000.);
-			lfo.prepareToPlay(sampleRate);
+			lfo.prepareToPlay(sampleRate / static_cast<double>(ControlRate));
 			lfo.setFrequency(1.f);
-			ringBuffer.resize(size + 1, 0.f);
+			auto ringSize = 1;
+			while (ringSize < size + 4)
+				ringSize <<= 1;
+			mask = ringSize - 1;
+			ringBuffer.assign(ringSize * 2, 0.f);
 			writeHead = 0;
+			controlIdx = 0;
+			delay = static_cast<float>(size) * .5f;
+			delayInc = 0.f;
+			apState = 0.f;
 		}
 		void setFrequency(float f) noexcept { lfo.setFrequency(f); }
-		void process(float* samples, int numSamples)
+		void setDepth(float d) noexcept { depth = d; }
+		void setInterpolation(Interpolation i) noexcept { interpolation = i; }
+		void process(float* samples, int numSamples) noexcept
 		{
-			for (auto s = 0; s < numSamples; ++s)
+			const auto kernel = getKernel();
+			// the control path runs in the generic build, so that every isa reads at the same delay times
+			for (auto s = 0; s < numSamples;)
 			{
-				writeHead = (writeHead + 1) % size;
-				const auto lfoNormal = .9f * depth * lfo.process() * .5f + .5f;
-				const auto lfoMapped = lfoNormal * static_cast<float>(size);
-				auto readHead = static_cast<float>(writeHead) - lfoMapped;
-				if (readHead < 0.f)
-					readHead += static_cast<float>(size);
-
-				ringBuffer[writeHead] = samples[s];
-				samples[s] = lerp(readHead);
+				if (controlIdx == 0)
+					updateControl();
+				const auto n = std::min(numSamples - s, ControlRate - controlIdx);
+				kernel(*this, samples + s, n);
+				controlIdx = (controlIdx + n) & (ControlRate - 1);
+				s += n;
 			}
 		}
-		int getLatency() const noexcept { return static_cast<int>(ringBuffer.size() / 2); }
-
+		/* advances the lfo and the write head without audio, only valid while the ring buffer is silent */
+		void skip(int numSamples) noexcept
+		{
+			for (auto s = 0; s < numSamples; ++s)
+				tick();
+			writeHead = (writeHead + numSamples) & mask;
+			apState = 0.f;
+		}
+		/* the delay at the centre of the modulation */
+		double getLatency() const noexcept { return static_cast<double>(size) * .5; }
+	protected:
 		SineOsc lfo;
 		std::vector<float> ringBuffer;
-		float depth;
-		int writeHead, size;
+		Interpolation interpolation;
+		float depth, delay, delayInc, apState;
+		int writeHead, size, mask, controlIdx;
 
-		float lerp(float rHead) noexcept
+		using Kernel = void(*)(Vibrato&, float*, int);
+
+		Kernel getKernel() const noexcept
 		{
-			const auto xFloor = int(rHead);
-			const auto x = rHead - xFloor;
-			const auto xCeil = (xFloor + 1) % size;
-			return ringBuffer[xFloor] + x * (ringBuffer[xCeil] - ringBuffer[xFloor]);
+			switch (interpolation)
+			{
+			case Interpolation::Linear: return oversampling::Dispatched<&processKernel<Interpolation::Linear>>::get();
+			case Interpolation::Cubic: return oversampling::Dispatched<&processKernel<Interpolation::Cubic>>::get();
+			case Interpolation::Lagrange: return oversampling::Dispatched<&processKernel<Interpolation::Lagrange>>::get();
+			default: return oversampling::Dispatched<&processKernel<Interpolation::Allpass>>::get();
+			}
+		}
+
+		void updateControl() noexcept
+		{
+			const auto lfoNormal = .9f * depth * lfo.process() * .5f + .5f;
+			const auto target = lfoNormal * static_cast<float>(size);
+			delayInc = (target - delay) * (1.f / static_cast<float>(ControlRate));
+		}
+		void tick() noexcept
+		{
+			if (controlIdx == 0)
+				updateControl();
+			controlIdx = (controlIdx + 1) & (ControlRate - 1);
+			delay += delayInc;
+		}
+
+		/* numSamples must not cross a control tick */
+		template<Interpolation Interp>
+		static void processKernel(Vibrato& vibrato, float* samples, int numSamples) noexcept
+		{
+			vibrato.process<Interp>(samples, numSamples);
+		}
+
+		template<Interpolation Interp>
+		void process(float* samples, int numSamples) noexcept
+		{
+			const auto ringSize = mask + 1;
+			auto buf = ringBuffer.data();
+			for (auto s = 0; s < numSamples; ++s)
+			{
+				delay += delayInc;
+
+				writeHead = (writeHead + 1) & mask;
+				buf[writeHead] = buf[writeHead + ringSize] = samples[s];
+				samples[s] = read<Interp>(buf);
+			}
+		}
+
+		template<Interpolation Interp>
+		float read(const float* buf) noexcept
+		{
+			if (Interp == Interpolation::Allpass)
+			{ // delay = m + d, d in [.5, 1.5)
+				const auto m = static_cast<int>(delay - .5f);
+				const auto d = delay - static_cast<float>(m);
+				const auto eta = (1.f - d) / (1.f + d);
+				const auto x = buf + ((writeHead - m - 1) & mask);
+				apState = eta * (x[1] - apState) + x[0];
+				return apState;
+			}
+			// x[3] is the newest, the fraction t goes from x[2] towards x[1]
+			const auto m = static_cast<int>(delay);
+			const auto t = delay - static_cast<float>(m);
+			const auto x = buf + ((writeHead - m - 2) & mask);
+			if (Interp == Interpolation::Linear)
+				return x[2] + t * (x[1] - x[2]);
+			if (Interp == Interpolation::Cubic)
+			{ // hermite
+				const auto c1 = .5f * (x[1] - x[3]);
+				const auto c2 = x[3] - 2.5f * x[2] + 2.f * x[1] - .5f * x[0];
+				const auto c3 = .5f * (x[0] - x[3]) + 1.5f * (x[2] - x[1]);
+				return ((c3 * t + c2) * t + c1) * t + x[2];
+			}
+			// 3rd order lagrange
+			const auto tP1 = t + 1.f;
+			const auto tM1 = t - 1.f;
+			const auto tM2 = t - 2.f;
+			return
+				- x[3] * t * tM1 * tM2 * (1.f / 6.f)
+				+ x[2] * tP1 * tM1 * tM2 * .5f
+				- x[1] * tP1 * t * tM2 * .5f
+				+ x[0] * tP1 * t * tM1 * (1.f / 6.f);
 		}
 	};
 }
\ No newline at end of file
@@ -10,9 +10,17 @@ namespace param
 		VibratoDepth,
 		WaveFolderDrive,
 		SaturatorDrive,
+		InternalRate,
 		EnumSize
 	};
 
+	/* values of ID::InternalRate, see oversampling::Processor::setInternalRate. 0 processes at a multiple of the host's rate */
+	static constexpr std::array<double, 5> InternalRates = { 0., 88200., 96000., 176400., 192000. };
+	static double getInternalRate(float value)
+	{
+		return InternalRates[juce::jlimit(0, static_cast<int>(InternalRates.size()) - 1, static_cast<int>(std::rint(value)))];
+	}
+
 	// PARAMETER ID STUFF
 	static juce::String getName(ID i)
 	{
@@ -23,6 +31,7 @@ namespace param
 		case ID::VibratoDepth: return "Vibrato Depth";
 		case ID::WaveFolderDrive: return "WaveFolder Drive";
 		case ID::SaturatorDrive: return "Saturator Drive";
+		case ID::InternalRate: return "Internal Rate";
 		default: return "";
 		}
 	}
@@ -128,12 +137,17 @@ namespace param
 		const auto phaseStr = [](float value, int) {
 			return juce::String(std::floor(value * 180.f)) + " dgr";
 		};
+		const auto rateStr = [](float value, int) {
+			const auto rate = getInternalRate(value);
+			return rate == 0. ? juce::String("Off") : juce::String(rate * .001, 1) + " khz";
+		};
 
 		parameters.push_back(createParameter(ID::Gain, 0.f, dbStr, -40.f, 40.f));
 		parameters.push_back(createParameter(ID::VibratoFreq, 0.f, freqStr, .1f, 20.f));
 		parameters.push_back(createParameter(ID::VibratoDepth, 1.f, percentStr));
 		parameters.push_back(createParameter(ID::WaveFolderDrive, 0.f, dbStr, 0.f, 24.f));
 		parameters.push_back(createParameter(ID::SaturatorDrive, 0.f, percentStr));
+		parameters.push_back(createParameter(ID::InternalRate, 0.f, rateStr, 0.f, static_cast<float>(InternalRates.size() - 1), 1.f));
 		
 		return { parameters.begin(), parameters.end() };
 	}
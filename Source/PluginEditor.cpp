@@ -5,12 +5,20 @@ OversamplingTestAudioProcessorEditor::OversamplingTestAudioProcessorEditor(Overs
     AudioProcessorEditor(&p),
     audioProcessor(p),
     oversamplingEnabledButton(),
+    draftButton(),
+    recordButton(),
 
     gain(p, param::ID::Gain),
     vibratoFreq(p, param::ID::VibratoFreq),
     vibratoDepth(p, param::ID::VibratoDepth),
     wavefolderDrive(p, param::ID::WaveFolderDrive),
-    saturatorDrive(p, param::ID::SaturatorDrive)
+    saturatorDrive(p, param::ID::SaturatorDrive),
+    internalRate(p, param::ID::InternalRate),
+    analyzerView(p.graph.getAnalyzer()),
+    governorView(p.graph.getGovernor())
+#if PROFILER_ENABLED
+    , profilerView(p.graph.getProfiler())
+#endif
 {
     addAndMakeVisible(oversamplingEnabledButton);
     oversamplingEnabledButton.name = "OverSampling\nEnabled";
@@ -24,15 +32,55 @@ OversamplingTestAudioProcessorEditor::OversamplingTestAudioProcessorEditor(Overs
     };
     oversamplingEnabledButton.getState();
 
+    addAndMakeVisible(draftButton);
+    draftButton.name = "Draft\nQuality";
+    draftButton.getState = [this]() {
+        draftButton.state = audioProcessor.oversampling.isDraft();
+        return draftButton.state;
+    };
+    draftButton.onClick = [this]() {
+        draftButton.state = !audioProcessor.oversampling.isDraft();
+        audioProcessor.oversampling.setDraft(draftButton.state);
+        // saved with the session, so that a sketch reopens as one
+        audioProcessor.apvts.state.setProperty("draft", draftButton.state, nullptr);
+    };
+    draftButton.getState();
+
+    addAndMakeVisible(recordButton);
+    recordButton.name = "Record\nCapture";
+    recordButton.getState = [this]() {
+        recordButton.state = audioProcessor.recorder.isRecording();
+        return recordButton.state;
+    };
+    recordButton.onClick = [this]() {
+        if (audioProcessor.recorder.isRecording())
+            audioProcessor.recorder.stopRecording();
+        else
+            audioProcessor.recorder.startRecording(capture::getDefaultFolder()
+                .getNonexistentChildFile("OversamplingTestCapture", ".oscap"));
+        recordButton.getState();
+    };
+    recordButton.getState();
+
     addAndMakeVisible(gain);
     addAndMakeVisible(vibratoFreq);
     addAndMakeVisible(vibratoDepth);
     addAndMakeVisible(wavefolderDrive);
     addAndMakeVisible(saturatorDrive);
+    addAndMakeVisible(internalRate);
+    addAndMakeVisible(analyzerView);
+    addAndMakeVisible(governorView);
+#if PROFILER_ENABLED
+    addAndMakeVisible(profilerView);
+#endif
     
     setOpaque(true);
     auto w = (int)p.apvts.state.getProperty("allWidth", 400);
     auto h = (int)p.apvts.state.getProperty("allHeight", 100);
+    h += AnalyzerView::Height + GovernorView::Height;
+#if PROFILER_ENABLED
+    h += ProfilerView::Height;
+#endif
     setSize (w, h);
 }
 
@@ -47,9 +95,20 @@ void OversamplingTestAudioProcessorEditor::resized()
     auto x = 0;
     auto y = 0;
     auto w = getWidth();
-    auto h = getHeight();
-    auto wNum = w / 6;
-    oversamplingEnabledButton.setBounds(x,y,wNum,h);
+    auto h = getHeight() - AnalyzerView::Height;
+    analyzerView.setBounds(0, h, w, AnalyzerView::Height);
+    h -= GovernorView::Height;
+    governorView.setBounds(0, h, w, GovernorView::Height);
+#if PROFILER_ENABLED
+    h -= ProfilerView::Height;
+    profilerView.setBounds(0, h, w, ProfilerView::Height);
+#endif
+    auto wNum = w / 7;
+    oversamplingEnabledButton.setBounds(x,y,wNum,h / 3);
+    draftButton.setBounds(x, y + h / 3, wNum, h / 3);
+    recordButton.setBounds(x, y + 2 * (h / 3), wNum, h - 2 * (h / 3));
+    x += wNum;
+    internalRate.setBounds(x, y, wNum, h);
     x += wNum;
     wavefolderDrive.setBounds(x, y, wNum, h);
     x += wNum;
@@ -62,5 +121,5 @@ void OversamplingTestAudioProcessorEditor::resized()
     gain.setBounds(x, y, wNum, h);
 
     audioProcessor.apvts.state.setProperty("allWidth", getWidth(), nullptr);
-    audioProcessor.apvts.state.setProperty("allHeight", getHeight(), nullptr);
+    audioProcessor.apvts.state.setProperty("allHeight", h, nullptr);
 }
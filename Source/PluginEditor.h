@@ -3,6 +3,38 @@
 #include "PluginProcessor.h"
 #include <functional>
 
+/*
+* one timer that serves all components of all editors.
+* components ask for a repaint and get repainted at most FPS times per second,
+* no matter how often they asked in between.
+*/
+struct RepaintCoalescer :
+	public juce::Timer
+{
+	static constexpr int FPS = 30;
+
+	RepaintCoalescer() :
+		dirty()
+	{}
+	void repaintLater(juce::Component* comp) {
+		dirty.addIfNotAlreadyThere(comp);
+		if (!isTimerRunning())
+			startTimerHz(FPS);
+	}
+	/* call this in the destructor of a component that used repaintLater */
+	void cancel(juce::Component* comp) { dirty.removeFirstMatchingValue(comp); }
+protected:
+	juce::Array<juce::Component*> dirty;
+
+	void timerCallback() override {
+		if (dirty.isEmpty())
+			return stopTimer();
+		for (auto comp : dirty)
+			comp->repaint();
+		dirty.clearQuick();
+	}
+};
+
 struct SwitchButton :
     public juce::Component
 {
@@ -104,6 +136,12 @@ protected:
 		showTick = !showTick;
 		repaint();
 	}
+	void focusLost(FocusChangeType) override {
+		// the tick only blinks while typing
+		stopTimer();
+		showTick = false;
+		repaint();
+	}
 
 	bool keyPressed(const juce::KeyPress& key) override {
 		const auto code = key.getKeyCode();
@@ -167,29 +205,45 @@ struct Knob :
 {
 	Knob(OversamplingTestAudioProcessor& p, param::ID pID) :
 		rap(*p.apvts.getParameter(param::getID(pID))),
-		attach(rap, [this](float value) { repaint(); }, nullptr)
+		coalescer(),
+		attach(rap, [this](float value) { coalescer->repaintLater(this); }, nullptr),
+		background(),
+		dragStartValue(0.f)
 	{
 		attach.sendInitialUpdate();
-		setBufferedToImage(true);
 	}
+	~Knob() override { coalescer->cancel(this); }
 protected:
 	juce::RangedAudioParameter& rap;
+	juce::SharedResourcePointer<RepaintCoalescer> coalescer;
 	juce::ParameterAttachment attach;
+	juce::Image background;
 	float dragStartValue;
 
-	void paint(juce::Graphics& g) override {
-		const auto width = static_cast<float>(getWidth());
-		const auto height = static_cast<float>(getHeight());
-		const auto piQuart = 3.14f / 4.f;
-		const auto value = rap.getValue();
-		juce::PathStrokeType strokeType(2.f, juce::PathStrokeType::JointStyle::curved, juce::PathStrokeType::EndCapStyle::rounded);
-		const juce::Point<float> centre(width * .5f, height * .5f);
-		const auto radius = std::min(centre.x, centre.y) - 2.f;
-		const auto startAngle = -piQuart * 3.f;
-		const auto endAngle = piQuart * 3.f;
-		const auto angleRange = endAngle - startAngle;
-		const auto valueAngle = startAngle + angleRange * value;
+	static constexpr float piQuart = 3.14f / 4.f;
+	static constexpr float startAngle = -piQuart * 3.f;
+	static constexpr float endAngle = piQuart * 3.f;
 
+	juce::Point<float> getCentre() const noexcept {
+		return { static_cast<float>(getWidth()) * .5f, static_cast<float>(getHeight()) * .5f };
+	}
+	float getRadius() const noexcept {
+		const auto centre = getCentre();
+		return std::min(centre.x, centre.y) - 2.f;
+	}
+
+	void resized() override {
+		// the arcs and the name only change with the size, so they are drawn once per size
+		const auto scale = juce::Component::getApproximateScaleFactorForComponent(this);
+		const auto w = juce::jmax(1, juce::roundToInt(static_cast<float>(getWidth()) * scale));
+		const auto h = juce::jmax(1, juce::roundToInt(static_cast<float>(getHeight()) * scale));
+		background = juce::Image(juce::Image::ARGB, w, h, true);
+		juce::Graphics g(background);
+		g.addTransform(juce::AffineTransform::scale(scale));
+
+		juce::PathStrokeType strokeType(2.f, juce::PathStrokeType::JointStyle::curved, juce::PathStrokeType::EndCapStyle::rounded);
+		const auto centre = getCentre();
+		const auto radius = getRadius();
 		g.setColour(juce::Colours::limegreen);
 		juce::Path pathNorm;
 		pathNorm.addCentredArc(centre.x, centre.y, radius, radius,
@@ -202,6 +256,17 @@ protected:
 			true
 		);
 		g.strokePath(pathNorm, strokeType);
+		g.drawFittedText(rap.getName(13), getLocalBounds(), juce::Justification::centredTop, 1);
+	}
+
+	void paint(juce::Graphics& g) override {
+		g.drawImage(background, getLocalBounds().toFloat());
+
+		const auto value = rap.getValue();
+		const auto centre = getCentre();
+		const auto radius = getRadius();
+		const auto angleRange = endAngle - startAngle;
+		const auto valueAngle = startAngle + angleRange * value;
 
 		const auto valueLine = juce::Line<float>::fromStartAndAngle(centre, radius + 1.f, valueAngle);
 		const auto tickBGThiccness = 2.f * 2.f;
@@ -209,7 +274,6 @@ protected:
 		g.drawLine(valueLine, tickBGThiccness);
 		g.setColour(juce::Colours::limegreen);
 		g.drawLine(valueLine.withShortenedStart(radius - 2.f * 3.f), 2.f);
-		g.drawFittedText(rap.getName(13), getLocalBounds(), juce::Justification::centredTop, 1);
 		g.drawFittedText(rap.getCurrentValueAsText(), getLocalBounds(), juce::Justification::centredBottom, 1);
 	}
 
@@ -251,6 +315,194 @@ protected:
 };
 
 
+struct AnalyzerView :
+	public juce::Component
+{
+	static constexpr int Height = 160;
+	static constexpr float MinFreq = 20.f;
+
+	AnalyzerView(analyzer::Analyzer& a) :
+		spectrum(a),
+		worker(),
+		binsPre(), binsPost(),
+		lastFrameIdx(-1),
+		vblank(this, [this]() { onVBlank(); })
+	{
+		spectrum.addView();
+		worker->add(&spectrum);
+		setOpaque(true);
+	}
+	~AnalyzerView() override {
+		spectrum.removeView();
+		if (!spectrum.isActive())
+			worker->remove(&spectrum);
+	}
+protected:
+	analyzer::Analyzer& spectrum;
+	juce::SharedResourcePointer<analyzer::Worker> worker;
+	analyzer::Bins binsPre, binsPost;
+	int lastFrameIdx;
+	juce::VBlankAttachment vblank;
+
+	void onVBlank() {
+		const auto frameIdx = spectrum.getFrameIdx();
+		if (frameIdx == lastFrameIdx) return;
+		lastFrameIdx = frameIdx;
+		spectrum.getBins(binsPre, binsPost);
+		repaint();
+	}
+
+	void paint(juce::Graphics& g) override {
+		g.fillAll(juce::Colours::black);
+		const auto bounds = getLocalBounds().toFloat().reduced(2);
+		g.setColour(juce::Colours::limegreen);
+		g.drawRoundedRectangle(bounds, 2, 2);
+
+		const auto fsPre = static_cast<float>(spectrum.getSampleRatePre());
+		const auto fsPost = static_cast<float>(spectrum.getSampleRatePost());
+		const auto maxFreq = fsPre * .5f;
+		const auto logRangeInv = 1.f / std::log(maxFreq / MinFreq);
+		const auto freqToX = [&](float f) {
+			return bounds.getX() + bounds.getWidth() * std::log(f / MinFreq) * logRangeInv;
+		};
+		const auto dbToY = [&](float db) {
+			return bounds.getY() + bounds.getHeight() * db / analyzer::MinDb;
+		};
+
+		const auto nyquistX = freqToX(fsPost * .5f);
+		g.setColour(juce::Colour(0x44ffffff));
+		g.drawVerticalLine(static_cast<int>(nyquistX), bounds.getY(), bounds.getBottom());
+
+		const auto makePath = [&](const analyzer::Bins& bins, float fs) {
+			// one point per pixel, keeps the peak of all bins that fall into it
+			juce::Path path;
+			const auto binToFreq = fs / static_cast<float>(analyzer::FFTSize);
+			auto lastX = -1;
+			auto peak = analyzer::MinDb;
+			for (auto b = 1; b < analyzer::NumBins; ++b) {
+				const auto f = static_cast<float>(b) * binToFreq;
+				if (f < MinFreq) continue;
+				const auto x = static_cast<int>(freqToX(f));
+				peak = std::max(peak, bins[b]);
+				if (x == lastX && b != analyzer::NumBins - 1) continue;
+				if (path.isEmpty())
+					path.startNewSubPath(static_cast<float>(x), dbToY(peak));
+				else
+					path.lineTo(static_cast<float>(x), dbToY(peak));
+				lastX = x;
+				peak = analyzer::MinDb;
+			}
+			return path;
+		};
+		const juce::PathStrokeType strokeType(1.f);
+		g.setColour(juce::Colours::limegreen.withAlpha(.4f));
+		g.strokePath(makePath(binsPre, fsPre), strokeType);
+		g.setColour(juce::Colours::limegreen);
+		g.strokePath(makePath(binsPost, fsPost), strokeType);
+		g.drawFittedText("pre / post downsampling", bounds.toNearestInt(), juce::Justification::topRight, 1);
+	}
+};
+
+/* shows the quality tier the cpu governor currently runs at */
+struct GovernorView :
+	public juce::Component,
+	public juce::Timer
+{
+	static constexpr int Height = 24;
+
+	GovernorView(governor::Governor& g) :
+		gov(g),
+		tier(g.getTier())
+	{
+		setBufferedToImage(true);
+		startTimerHz(4);
+	}
+protected:
+	governor::Governor& gov;
+	governor::Tier tier;
+
+	void timerCallback() override {
+		const auto t = gov.getTier();
+		if (t == tier) return;
+		tier = t;
+		repaint();
+	}
+
+	void paint(juce::Graphics& g) override {
+		const auto bounds = getLocalBounds().toFloat().reduced(2);
+		g.setColour(tier == governor::Tier::Full ? juce::Colours::limegreen : juce::Colours::orange);
+		g.drawRoundedRectangle(bounds, 2, 2);
+		g.drawFittedText("Quality: " + governor::toString(tier), bounds.toNearestInt(), juce::Justification::centred, 1);
+	}
+};
+
+#if PROFILER_ENABLED
+struct ProfilerView :
+	public juce::Component,
+	public juce::Timer
+{
+	static constexpr int Height = 120;
+
+	ProfilerView(profiler::Profiler& p) :
+		prof(p),
+		stats()
+	{
+		setBufferedToImage(true);
+		startTimerHz(10);
+	}
+protected:
+	profiler::Profiler& prof;
+	std::array<profiler::Stats, profiler::MaxNumStages> stats;
+
+	void timerCallback() override {
+		stats = prof.getStats();
+		repaint();
+	}
+
+	void paint(juce::Graphics& g) override {
+		const auto bounds = getLocalBounds().toFloat().reduced(2);
+		g.setColour(juce::Colours::limegreen);
+		g.drawRoundedRectangle(bounds, 2, 2);
+		const auto numStages = prof.getNumStages();
+		if (numStages == 0) return;
+		const auto rowHeight = bounds.getHeight() / static_cast<float>(numStages + 1);
+		const auto nameWidth = bounds.getWidth() * .2f;
+		const auto barWidth = bounds.getWidth() * .4f;
+		auto y = bounds.getY();
+		g.drawFittedText(prof.isLogging() ? "logging to desktop (click to stop)" : "click to log csv to desktop",
+			juce::Rectangle<float>(bounds.getX(), y, bounds.getWidth(), rowHeight).toNearestInt(),
+			juce::Justification::centred, 1);
+		y += rowHeight;
+		for (auto st = 0; st < numStages; ++st) {
+			const auto& s = stats[st];
+			const auto x = bounds.getX();
+			g.drawFittedText(prof.getName(st),
+				juce::Rectangle<float>(x, y, nameWidth, rowHeight).toNearestInt(),
+				juce::Justification::centredLeft, 1);
+			const auto load = juce::jlimit(0.f, 1.f, s.load);
+			g.fillRect(x + nameWidth, y + 1.f, barWidth * load, rowHeight - 2.f);
+			g.drawRect(x + nameWidth, y + 1.f, barWidth, rowHeight - 2.f);
+			const auto txt = juce::String(s.load * 100.f, 1) + " % | mean " + juce::String(s.mean, 3)
+				+ " ms | p99 " + juce::String(s.p99, 3) + " ms | max " + juce::String(s.max, 3) + " ms";
+			g.drawFittedText(txt,
+				juce::Rectangle<float>(x + nameWidth + barWidth + 4.f, y, bounds.getRight() - x - nameWidth - barWidth - 4.f, rowHeight).toNearestInt(),
+				juce::Justification::centredLeft, 1);
+			y += rowHeight;
+		}
+	}
+
+	void mouseUp(const juce::MouseEvent& evt) override {
+		if (evt.mouseWasDraggedSinceMouseDown()) return;
+		if (prof.isLogging())
+			prof.stopLogging();
+		else
+			prof.startLogging(juce::File::getSpecialLocation(juce::File::userDesktopDirectory)
+				.getNonexistentChildFile("OversamplingTestProfile", ".csv"));
+		repaint();
+	}
+};
+#endif
+
 class OversamplingTestAudioProcessorEditor  : public juce::AudioProcessorEditor
 {
 public:
@@ -261,9 +513,14 @@ public:
     void resized() override;
 
     OversamplingTestAudioProcessor& audioProcessor;
-    SwitchButton oversamplingEnabledButton;
+    SwitchButton oversamplingEnabledButton, draftButton, recordButton;
 
-	Knob gain, vibratoFreq, vibratoDepth, wavefolderDrive, saturatorDrive;
+	Knob gain, vibratoFreq, vibratoDepth, wavefolderDrive, saturatorDrive, internalRate;
+	AnalyzerView analyzerView;
+	GovernorView governorView;
+#if PROFILER_ENABLED
+	ProfilerView profilerView;
+#endif
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (OversamplingTestAudioProcessorEditor)
 };
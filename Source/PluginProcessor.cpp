@@ -21,25 +21,105 @@ OversamplingTestAudioProcessor::OversamplingTestAudioProcessor()
                      #endif
                        ),
     oversampling(this),
+    calibration(),
+    offlinePlanned(false),
     // DSP
     vibrato(),
     wavefolder(),
     saturator(),
+    gainSmooth(1.f),
+    waveFolderDriveSmooth(1.f),
+    saturatorDriveSmooth(0.f, dsp::Smooth::Type::Linear),
+    waveFolderDriveSmoothDry(1.f),
+    saturatorDriveSmoothDry(0.f, dsp::Smooth::Type::Linear),
+    graph(oversampling, getTotalNumOutputChannels()),
     // PARAMS
     apvts(*this, nullptr, "params", param::createParameters()),
     gainP(apvts.getRawParameterValue(param::getID(param::ID::Gain))),
     vibFreqP(apvts.getRawParameterValue(param::getID(param::ID::VibratoFreq))),
     vibDepthP(apvts.getRawParameterValue(param::getID(param::ID::VibratoDepth))),
     waveFolderDriveP(apvts.getRawParameterValue(param::getID(param::ID::WaveFolderDrive))),
-    saturatorDriveP(apvts.getRawParameterValue(param::getID(param::ID::SaturatorDrive)))
+    saturatorDriveP(apvts.getRawParameterValue(param::getID(param::ID::SaturatorDrive))),
+    internalRateP(apvts.getRawParameterValue(param::getID(param::ID::InternalRate))),
+    recorder(static_cast<int>(param::ID::EnumSize))
 #endif
 {
     vibrato.resize(getTotalNumInputChannels());
+    // the audio thread switched to new oversampling settings, see ProcessingGraph::applyUpdate
+    oversampling.onUpdate = [this]() { setLatencySamples(graph.getLatency()); };
+    apvts.addParameterListener(param::getID(param::ID::InternalRate), this);
+    calibration->addChangeListener(this);
+    calibration->requestPlan(OfflineRequirements);
+    applyOfflinePlan();
+
+    graph.addNode({ "Vibrato", false, dsp::Rate::Base,
+        [this](double sampleRate, int blockSize)
+        {
+            for (auto& v : vibrato)
+                v.prepareToPlay(sampleRate, blockSize);
+        },
+        [this](juce::AudioBuffer<float>& buffer)
+        {
+            const auto vibFreq = vibFreqP->load();
+            const auto vibDepth = vibDepthP->load();
+            const auto interpolation = graph.getGovernor().getTier() == governor::Tier::Full ?
+                dsp::Interpolation::Cubic : dsp::Interpolation::Linear;
+            auto samples = buffer.getArrayOfWritePointers();
+            const auto numChannels = std::min(static_cast<int>(vibrato.size()), buffer.getNumChannels());
+            for (auto ch = 0; ch < numChannels; ++ch)
+            {
+                vibrato[ch].setInterpolation(interpolation);
+                vibrato[ch].setDepth(vibDepth);
+                vibrato[ch].setFrequency(vibFreq);
+                vibrato[ch].process(samples[ch], buffer.getNumSamples());
+            }
+        },
+        [this]() { return vibrato[0].getLatency(); },
+        nullptr,
+        [this](int numSamples)
+        {
+            for (auto& v : vibrato)
+            {
+                v.setDepth(vibDepthP->load());
+                v.setFrequency(vibFreqP->load());
+                v.skip(numSamples);
+            }
+        },
+        [this]()
+        {
+            for (auto ch = 1; ch < vibrato.size(); ++ch)
+                vibrato[ch] = vibrato[0];
+        }
+    });
+    // the dry twins keep their own smoothing at the host's rate, see dsp::ProcessingGraph
+    graph.addNode(makeWavefolderNode(waveFolderDriveSmooth), makeWavefolderNode(waveFolderDriveSmoothDry));
+    graph.addNode(makeSaturatorNode(saturatorDriveSmooth), makeSaturatorNode(saturatorDriveSmoothDry));
+    graph.addNode({ "Gain", false, dsp::Rate::Base,
+        [this](double sampleRate, int blockSize) { gainSmooth.prepareToPlay(sampleRate, blockSize); },
+        [this](juce::AudioBuffer<float>& buffer)
+        {
+            const auto gainV = juce::Decibels::decibelsToGain(gainP->load());
+            const auto numSamples = buffer.getNumSamples();
+            if (gainSmooth.process(gainV, numSamples))
+            {
+                auto samples = buffer.getArrayOfWritePointers();
+                for (auto ch = 0; ch < buffer.getNumChannels(); ++ch)
+                    juce::FloatVectorOperations::multiply(samples[ch], gainSmooth.data(), numSamples);
+            }
+            else
+                buffer.applyGain(gainV);
+        },
+        nullptr,
+        nullptr,
+        [this](int numSamples) { gainSmooth.process(juce::Decibels::decibelsToGain(gainP->load()), numSamples); }
+    });
 }
     
 
 OversamplingTestAudioProcessor::~OversamplingTestAudioProcessor()
 {
+    apvts.removeParameterListener(param::getID(param::ID::InternalRate), this);
+    calibration->removeChangeListener(this);
 }
 
 //==============================================================================
@@ -107,16 +187,9 @@ void OversamplingTestAudioProcessor::changeProgramName (int index, const juce::S
 //==============================================================================
 void OversamplingTestAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    oversampling.prepareToPlay(sampleRate, samplesPerBlock);
-    sampleRate = oversampling.getSampleRateUpsampled();
-    samplesPerBlock = oversampling.getBlockSizeUp();
-    auto latency = oversampling.getLatency();
-
-    for(auto& v: vibrato)
-        v.prepareToPlay(sampleRate, samplesPerBlock);
-    latency += vibrato[0].getLatency() / oversampling.getUpsamplingFactor();
-
-    setLatencySamples(latency);
+    graph.prepareToPlay(sampleRate, samplesPerBlock);
+    setLatencySamples(graph.getLatency());
+    prepareRecorder(sampleRate, samplesPerBlock);
 }
 
 void OversamplingTestAudioProcessor::releaseResources()
@@ -162,36 +235,14 @@ void OversamplingTestAudioProcessor::processBlock (juce::AudioBuffer<float>& buf
             buffer.clear(i, 0, numSamples);
     }
     
+    if (graph.applyUpdate())
+        prepareRecorder(getSampleRate(), getBlockSize());
+    record(buffer, false);
+
     const auto numChannelsIn = getChannelCountOfBus(true, 0);
     const auto numChannelsOut = buffer.getNumChannels();
 
-    // upsampling
-    auto bufferUp = oversampling.upsample(buffer, numChannelsIn, numChannelsOut);
-    if (bufferUp == nullptr)
-        bufferUp = &buffer;
-    numSamples = bufferUp->getNumSamples();
-    auto samples = bufferUp->getArrayOfWritePointers();
-
-    // non-linear processing
-    const auto vibFreq = vibFreqP->load();
-    const auto vibDepth = vibDepthP->load();
-    for (auto ch = 0; ch < vibrato.size(); ++ch)
-    {
-        vibrato[ch].depth = vibDepth;
-        vibrato[ch].setFrequency(vibFreq);
-        vibrato[ch].process(samples[ch], numSamples);
-    }
-    wavefolder.setDrive(juce::Decibels::decibelsToGain(waveFolderDriveP->load()));
-    wavefolder.processBlock(*bufferUp);
-    saturator.setDrive(saturatorDriveP->load());
-    saturator.processBlock(*bufferUp);
-    
-    // downsampling
-    if(bufferUp != &buffer)
-        oversampling.downsample(&buffer, numChannelsOut);
-
-    const auto gainV = juce::Decibels::decibelsToGain(gainP->load());
-    buffer.applyGain(gainV);
+    graph.processBlock(buffer, numChannelsIn, numChannelsOut);
 }
 
 //==============================================================================
@@ -218,7 +269,10 @@ void OversamplingTestAudioProcessor::setStateInformation (const void* data, int
     std::unique_ptr<juce::XmlElement> xmlState(getXmlFromBinary(data, sizeInBytes));
     if (xmlState.get() != nullptr)
         if (xmlState->hasTagName(apvts.state.getType()))
+        {
             apvts.replaceState(juce::ValueTree::fromXml(*xmlState));
+            oversampling.setDraft(apvts.state.getProperty("draft", false));
+        }
 }
 
 //==============================================================================
@@ -228,6 +282,102 @@ juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
     return new OversamplingTestAudioProcessor();
 }
 
-void OversamplingTestAudioProcessor::processBlockBypassed(juce::AudioBuffer<float>&, juce::MidiBuffer&) {
+void OversamplingTestAudioProcessor::processBlockBypassed(juce::AudioBuffer<float>& buffer, juce::MidiBuffer&)
+{
+    // only delays the input by the reported latency, so the bypassed track stays in time
+    juce::ScopedNoDenormals noDenormals;
+    auto numSamples = buffer.getNumSamples();
+    for (auto i = getTotalNumInputChannels(); i < getTotalNumOutputChannels(); ++i)
+        buffer.clear(i, 0, numSamples);
+
+    if (graph.applyUpdate())
+        prepareRecorder(getSampleRate(), getBlockSize());
+    record(buffer, true);
+
+    graph.processBlockBypassed(buffer, getChannelCountOfBus(true, 0), buffer.getNumChannels());
+}
+
+void OversamplingTestAudioProcessor::parameterChanged(const juce::String& parameterID, float newValue)
+{
+    // can come from the audio thread while the host automates it
+    if (parameterID == param::getID(param::ID::InternalRate))
+        oversampling.setInternalRate(param::getInternalRate(newValue));
+}
+
+void OversamplingTestAudioProcessor::applyOfflinePlan(int timeoutMs)
+{
+    oversampling::Plan plan;
+    if (offlinePlanned || !calibration->getPlan(OfflineRequirements, plan, timeoutMs))
+        return;
+    offlinePlanned = true;
+    // the firs are stored already, so this only measures the latency
+    if (plan.feasible)
+        oversampling.setConfig(plan.config, true);
+}
+
+void OversamplingTestAudioProcessor::prepareRecorder(double sampleRate, int samplesPerBlock) noexcept
+{
+    auto flags = 0u;
+    if (isNonRealtime()) flags |= capture::NonRealtime;
+    if (oversampling.isEnabled()) flags |= capture::OversamplingEnabled;
+    if (oversampling.isDraft()) flags |= capture::Draft;
+    recorder.prepare(sampleRate, samplesPerBlock, getTotalNumInputChannels(), getTotalNumOutputChannels(), flags);
+}
 
-}
\ No newline at end of file
+void OversamplingTestAudioProcessor::record(const juce::AudioBuffer<float>& buffer, bool bypassed) noexcept
+{
+    if (!recorder.isRecording())
+        return;
+    // same order as param::ID
+    const float params[] = { gainP->load(), vibFreqP->load(), vibDepthP->load(), waveFolderDriveP->load(), saturatorDriveP->load(), internalRateP->load() };
+    recorder.push(buffer, params, bypassed);
+}
+
+dsp::Node OversamplingTestAudioProcessor::makeWavefolderNode(dsp::Smooth& driveSmooth)
+{
+    return { "Wavefolder", true, dsp::Rate::Oversampled,
+        [&driveSmooth](double sampleRate, int blockSize) { driveSmooth.prepareToPlay(sampleRate, blockSize); },
+        [this, &driveSmooth](juce::AudioBuffer<float>& buffer)
+        {
+            const auto drive = juce::Decibels::decibelsToGain(waveFolderDriveP->load());
+            if (driveSmooth.process(drive, buffer.getNumSamples()))
+                wavefolder.processBlock(buffer, driveSmooth.data());
+            else
+            {
+                wavefolder.setDrive(drive);
+                wavefolder.processBlock(buffer);
+            }
+        },
+        nullptr,
+        [this, &driveSmooth](float peak)
+        {
+            const auto drive = juce::Decibels::decibelsToGain(waveFolderDriveP->load());
+            return !driveSmooth.isSmoothing() && dsp::Wavefolder::isTransparent(drive, peak);
+        },
+        [this, &driveSmooth](int numSamples) { driveSmooth.process(juce::Decibels::decibelsToGain(waveFolderDriveP->load()), numSamples); }
+    };
+}
+
+dsp::Node OversamplingTestAudioProcessor::makeSaturatorNode(dsp::Smooth& driveSmooth)
+{
+    return { "Saturator", true, dsp::Rate::Oversampled,
+        [&driveSmooth](double sampleRate, int blockSize) { driveSmooth.prepareToPlay(sampleRate, blockSize); },
+        [this, &driveSmooth](juce::AudioBuffer<float>& buffer)
+        {
+            const auto drive = saturatorDriveP->load();
+            if (driveSmooth.process(drive, buffer.getNumSamples()))
+                saturator.processBlock(buffer, driveSmooth.data());
+            else
+            {
+                saturator.setDrive(drive);
+                saturator.processBlock(buffer);
+            }
+        },
+        nullptr,
+        [this, &driveSmooth](float peak)
+        {
+            return !driveSmooth.isSmoothing() && dsp::Saturator::isTransparent(saturatorDriveP->load(), peak);
+        },
+        [this, &driveSmooth](int numSamples) { driveSmooth.process(saturatorDriveP->load(), numSamples); }
+    };
+}
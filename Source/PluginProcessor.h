@@ -2,7 +2,11 @@
 
 #include "Param.h"
 #include "oversampling/Oversampling.h"
+#include "oversampling/Planner.h"
 #include "NonLinearDSP.h"
+#include "ProcessingGraph.h"
+#include "Smoothing.h"
+#include "Capture.h"
 #include <JuceHeader.h>
 
 struct IDs
@@ -16,7 +20,9 @@ struct IDs
 };
 
 class OversamplingTestAudioProcessor :
-    public juce::AudioProcessor
+    public juce::AudioProcessor,
+    public juce::AudioProcessorValueTreeState::Listener,
+    public juce::ChangeListener
 {
 public:
     //==============================================================================
@@ -57,15 +63,44 @@ public:
     void setStateInformation (const void* data, int sizeInBytes) override;
 
     oversampling::Processor oversampling;
+    // measured filter costs for the planner, calibrated once per machine
+    juce::SharedResourcePointer<oversampling::Calibration> calibration;
+    bool offlinePlanned; // message thread
     
     std::vector<dsp::Vibrato> vibrato;
     dsp::Wavefolder wavefolder;
     dsp::Saturator saturator;
+    dsp::Smooth gainSmooth, waveFolderDriveSmooth, saturatorDriveSmooth;
+    dsp::Smooth waveFolderDriveSmoothDry, saturatorDriveSmoothDry; // of the dry twins
+    dsp::ProcessingGraph graph;
 
     juce::AudioProcessorValueTreeState apvts;
-    std::atomic<float> *gainP, *vibFreqP, *vibDepthP, *waveFolderDriveP, *saturatorDriveP;
+    std::atomic<float> *gainP, *vibFreqP, *vibDepthP, *waveFolderDriveP, *saturatorDriveP, *internalRateP;
+
+    // opt-in, records every block with its params for replaying it offline
+    capture::Recorder recorder;
 
     void processBlockBypassed(juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    /* the params that change the oversampling, which only records them, see oversampling::Processor */
+    void parameterChanged(const juce::String& parameterID, float newValue) override;
+    /*
+    * rendering uses the planner's config for OfflineRequirements once calibration planned it,
+    * the fixed offline config until then. timeoutMs -1 waits for the plan, e.g. to replay a session
+    */
+    void applyOfflinePlan(int timeoutMs = 0);
+    void changeListenerCallback(juce::ChangeBroadcaster*) override { applyOfflinePlan(); }
+
+    // rendering can afford to keep everything up to 21khz at 44.1khz intact
+    static constexpr oversampling::Requirements OfflineRequirements{ 8, .48f, 70.f };
+
+private:
+    /* also after the oversampling settings changed, so that a replay applies them at the same block */
+    void prepareRecorder(double sampleRate, int samplesPerBlock) noexcept;
+    /* hands the block to the recorder, if it's recording */
+    void record(const juce::AudioBuffer<float>& buffer, bool bypassed) noexcept;
+    /* driveSmooth is the node's own, so that the node and its dry twin don't share any state */
+    dsp::Node makeWavefolderNode(dsp::Smooth& driveSmooth);
+    dsp::Node makeSaturatorNode(dsp::Smooth& driveSmooth);
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (OversamplingTestAudioProcessor)
 };
@@ -0,0 +1,612 @@
+#pragma once
+#include "oversampling/Oversampling.h"
+#include "Profiler.h"
+#include "Analyzer.h"
+#include "Governor.h"
+#include <functional>
+#include <cstring>
+
+namespace dsp
+{
+	enum class Rate { Base, Oversampled };
+
+	/*
+	* one processing step of the chain.
+	* nonlinear nodes always run oversampled, linear ones run at their preferred rate,
+	* unless they sit between two oversampled nodes.
+	* latency is given in samples of the rate the node runs at and can be fractional.
+	* isTransparent tells if the node currently passes signals up to the given peak unchanged.
+	* skip is called instead of process while the graph is silent, to advance lfos and smoothers.
+	* sync copies the state the node keeps for the first channel to the others, see ProcessingGraph.
+	* nodes without state per channel don't need it.
+	* nodes in the oversampled range are prepared with the biggest upsampled block of any oversampling setting,
+	* and again with the same block size on the audio thread whenever the setting changes,
+	* so prepare mustn't allocate for a block size it has already been prepared with.
+	*/
+	struct Node
+	{
+		using AudioBuffer = juce::AudioBuffer<float>;
+		using PrepareFunc = std::function<void(double sampleRate, int blockSize)>;
+		using ProcessFunc = std::function<void(AudioBuffer& buffer)>;
+		using LatencyFunc = std::function<double()>;
+		using TransparentFunc = std::function<bool(float peak)>;
+		using SkipFunc = std::function<void(int numSamples)>;
+		using SyncFunc = std::function<void()>;
+
+		Node(juce::String&& _name, bool _nonlinear, Rate _preferredRate,
+			PrepareFunc&& _prepare, ProcessFunc&& _process, LatencyFunc&& _getLatency = nullptr,
+			TransparentFunc&& _isTransparent = nullptr, SkipFunc&& _skip = nullptr, SyncFunc&& _sync = nullptr) :
+			name(_name),
+			nonlinear(_nonlinear),
+			preferredRate(_nonlinear ? Rate::Oversampled : _preferredRate),
+			rate(preferredRate),
+			prepare(_prepare),
+			process(_process),
+			getLatency(_getLatency),
+			isTransparent(_isTransparent),
+			skip(_skip),
+			sync(_sync)
+		{}
+
+		bool needsOversampling() const noexcept { return preferredRate == Rate::Oversampled; }
+
+		juce::String name;
+		bool nonlinear;
+		Rate preferredRate, rate;
+		PrepareFunc prepare;
+		ProcessFunc process;
+		LatencyFunc getLatency;
+		TransparentFunc isTransparent;
+		SkipFunc skip;
+		SyncFunc sync;
+	};
+
+	/*
+	* runs a chain of nodes and wraps the smallest range of it that contains
+	* all nodes that need oversampling into a single up- and downsampling pair.
+	* everything before and after that range runs at the host's rate.
+	* the latencies of all nodes and of the oversampling filters are summed in samples of the
+	* host's rate. with latency alignment on, an allpass at the end of the chain pads
+	* the fractional total to the integer latency that gets reported.
+	* with adaptive oversampling on, the whole range is skipped while all of its nodes are
+	* transparent for the current peak level. the dry signal then goes through a delay line
+	* with the range's latency instead, so the total latency never changes.
+	* switching is crossfaded over one block. going back to oversampling first warms the range up
+	* for as long as the chain remembers, the same as coming out of the host's bypass.
+	* once the input has been silent for longer than the chain's memory and the output has
+	* decayed, blocks are skipped altogether until the first non-silent input sample.
+	* when the governor drops to the base rate tier, the range is bypassed the same way,
+	* but its nodes keep processing the delayed dry signal at the host's rate.
+	* the dry signal goes through the dry twins of the nodes, which have their own state, prepared at the host's rate.
+	* nodes added without one are left out of the dry signal. every block each state
+	* is either processed or skipped exactly once, so none of them runs twice or gets left behind.
+	* once all input channels have been identical for longer than the chain's memory (dual mono),
+	* or there is only one, the chain only processes the first channel and copies it to the others at the end.
+	* the first block that differs copies the state of the first channel to the others before it gets processed.
+	* while the host bypasses the plugin, the input only goes through a delay line with the reported latency,
+	* which is fed in every block, so the bypassed signal stays aligned. going into bypass is crossfaded over one block,
+	* coming out of it the chain warms up for as long as it remembers before the crossfade back.
+	*/
+	struct ProcessingGraph
+	{
+		using AudioBuffer = juce::AudioBuffer<float>;
+		static constexpr float PeakHeadroom = 1.25f; // room for inter-sample peaks
+		static constexpr double HoldMs = 100.; // before the oversampling gets bypassed
+		static constexpr float SilenceThreshold = 1e-6f; // -120dB
+
+		enum class HostBypass { Off, On, WarmingUp };
+
+		ProcessingGraph(oversampling::Processor& _oversampling, int numChannels) :
+			oversampling(_oversampling),
+			nodes(), dryNodes(),
+			alignment(numChannels),
+			bypassDelay(numChannels),
+			hostBypassDelay(numChannels),
+			dryBuffer(),
+			dryScratch(numChannels, nullptr),
+			hostBypassBuffer(),
+			hostBypassScratch(numChannels, nullptr),
+			silentSamples(numChannels, 0),
+			linkedBuffer(),
+			Fs(44100.), latencyFractional(0.), factorUp(1.),
+			blockSizeBase(0), blockSizeUpMax(0),
+			sectionStart(0), sectionEnd(0),
+			latency(0),
+			holdLength(0), holdSamples(0),
+			tailLength(0), linkedSamples(0), warmUpSamples(0), sectionWarmUpSamples(0),
+			outputPeak(0.f),
+			alignLatency(true),
+			adaptive(true), bypassed(false),
+			linking(true), linked(false),
+			hostBypass(HostBypass::Off),
+			aliasAnalyzer(),
+			cpuGovernor()
+#if PROFILER_ENABLED
+			, cpuProfiler(),
+			nodeStages(),
+			stageTotal(cpuProfiler.addStage("Total")),
+			stageUp(cpuProfiler.addStage("Upsample")),
+			stageDown(cpuProfiler.addStage("Downsample"))
+#endif
+		{}
+
+		void addNode(Node&& node)
+		{
+			addNode(std::move(node), Node(juce::String(node.name), node.nonlinear, Rate::Base, nullptr, nullptr));
+		}
+		/* dry is the same processing with state of its own, for the dry signal at the host's rate */
+		void addNode(Node&& node, Node&& dry)
+		{
+#if PROFILER_ENABLED
+			nodeStages.push_back(cpuProfiler.addStage(node.name));
+#endif
+			nodes.push_back(node);
+			dryNodes.push_back(dry);
+		}
+
+		void prepareToPlay(double sampleRate, int blockSize)
+		{
+			sectionStart = static_cast<int>(nodes.size());
+			sectionEnd = 0;
+			for (auto n = 0; n < nodes.size(); ++n)
+				if (nodes[n].needsOversampling())
+				{
+					sectionStart = std::min(sectionStart, n);
+					sectionEnd = n + 1;
+				}
+			if (sectionEnd == 0)
+				sectionStart = 0;
+
+			Fs = sampleRate;
+			blockSizeBase = blockSize;
+			oversampling.prepareToPlay(sampleRate, blockSize);
+#if PROFILER_ENABLED
+			cpuProfiler.prepareToPlay(sampleRate);
+#endif
+			cpuGovernor.prepareToPlay(sampleRate);
+
+			blockSizeUpMax = oversampling.getMaxBlockSizeUp();
+			for (auto n = 0; n < nodes.size(); ++n)
+			{
+				const auto oversampled = n >= sectionStart && n < sectionEnd;
+				if (!oversampled)
+					nodes[n].prepare(sampleRate, blockSize);
+				else if (dryNodes[n].prepare != nullptr)
+					dryNodes[n].prepare(sampleRate, blockSize);
+			}
+			// the dry paths and the oversampled buffer are needed in the same block
+			oversampling::ScratchArena::reserve(oversampling.getMaxScratchSize()
+				+ (dryScratch.size() + hostBypassScratch.size()) * oversampling::ScratchArena::getSize(static_cast<size_t>(blockSize)));
+			holdLength = static_cast<int>(sampleRate * HoldMs * .001);
+			prepareSection();
+			// an update only changes the oversampling's latency, up to the one of the slowest setting
+			const auto maxLatencyUp = hasSection() ? oversampling.getMaxLatencyFractional() : 0.;
+			bypassDelay.reserve(bypassDelay.getDelay() + maxLatencyUp, blockSize);
+			hostBypassDelay.reserve(latencyFractional + maxLatencyUp + 2., blockSize);
+		}
+
+		/*
+		* switches to the latest oversampling settings, see oversampling::Processor::applyUpdate.
+		* processBlock does it as well, returns true if it did
+		*/
+		bool applyUpdate() noexcept
+		{
+			return oversampling.applyUpdate([this]() { prepareSection(); });
+		}
+
+		void processBlock(AudioBuffer& buffer, int numChannelsIn, int numChannelsOut)
+		{
+			cpuGovernor.begin();
+			const oversampling::ScratchArena::Frame frame;
+			const auto numSamples = buffer.getNumSamples();
+			auto& delayed = delayHostBypass(buffer, numSamples);
+			if (hostBypass == HostBypass::On)
+			{
+				hostBypass = HostBypass::WarmingUp;
+				warmUpSamples = 0;
+			}
+			processLinked(buffer, numChannelsIn, numChannelsOut, numSamples);
+			if (hostBypass == HostBypass::WarmingUp)
+			{ // the chain still holds the signal from before the bypass
+				const auto numChannels = delayed.getNumChannels();
+				warmUpSamples = std::min(warmUpSamples + numSamples, tailLength);
+				if (warmUpSamples == tailLength)
+				{
+					crossfade(delayed.getArrayOfWritePointers(), buffer.getArrayOfReadPointers(), numChannels, numSamples);
+					hostBypass = HostBypass::Off;
+				}
+				for (auto ch = 0; ch < numChannels; ++ch)
+					buffer.copyFrom(ch, 0, delayed, ch, 0, numSamples);
+			}
+			cpuGovernor.end(numSamples);
+		}
+		/* for the host's bypass, delays the input by getLatency() */
+		void processBlockBypassed(AudioBuffer& buffer, int numChannelsIn, int numChannelsOut)
+		{
+			const auto numSamples = buffer.getNumSamples();
+			if (hostBypass == HostBypass::Off)
+			{ // fades out of the chain's output
+				cpuGovernor.begin();
+				const oversampling::ScratchArena::Frame frame;
+				auto& delayed = delayHostBypass(buffer, numSamples);
+				processLinked(buffer, numChannelsIn, numChannelsOut, numSamples);
+				crossfade(buffer.getArrayOfWritePointers(), delayed.getArrayOfReadPointers(), delayed.getNumChannels(), numSamples);
+				cpuGovernor.end(numSamples);
+			}
+			else
+				hostBypassDelay.processBlock(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), numSamples);
+			hostBypass = HostBypass::On;
+		}
+
+		bool hasSection() const noexcept { return sectionEnd > sectionStart; }
+		/* total latency of the chain in samples of the host's rate, includes the alignment padding */
+		int getLatency() const noexcept { return latency; }
+		/* total latency of the chain in samples of the host's rate before the alignment */
+		double getLatencyFractional() const noexcept { return latencyFractional; }
+		/* call prepareToPlay afterwards */
+		void setLatencyAlignment(bool e) noexcept { alignLatency = e; }
+		/* call prepareToPlay afterwards */
+		void setAdaptive(bool e) noexcept { adaptive = e; }
+		/* true while the oversampled range is skipped */
+		bool isBypassed() const noexcept { return bypassed; }
+		/* call prepareToPlay afterwards */
+		void setLinking(bool e) noexcept { linking = e; }
+		/* true while only the first channel is processed */
+		bool isLinked() const noexcept { return linked; }
+		/* true from the first bypassed block until the crossfade back has finished */
+		bool isHostBypassed() const noexcept { return hostBypass != HostBypass::Off; }
+		const std::vector<Node>& getNodes() const noexcept { return nodes; }
+		analyzer::Analyzer& getAnalyzer() noexcept { return aliasAnalyzer; }
+		governor::Governor& getGovernor() noexcept { return cpuGovernor; }
+#if PROFILER_ENABLED
+		profiler::Profiler& getProfiler() noexcept { return cpuProfiler; }
+#endif
+	protected:
+		oversampling::Processor& oversampling;
+		std::vector<Node> nodes, dryNodes;
+		oversampling::FractionalDelay<float> alignment;
+		oversampling::DelayLine<float> bypassDelay, hostBypassDelay;
+		AudioBuffer dryBuffer; // refers to dryScratch
+		std::vector<float*> dryScratch;
+		AudioBuffer hostBypassBuffer; // refers to hostBypassScratch
+		std::vector<float*> hostBypassScratch;
+		std::vector<int> silentSamples;
+		AudioBuffer linkedBuffer; // refers to the first channel of the host's buffer
+		double Fs, latencyFractional, factorUp;
+		int blockSizeBase, blockSizeUpMax;
+		int sectionStart, sectionEnd, latency, holdLength, holdSamples, tailLength, linkedSamples, warmUpSamples, sectionWarmUpSamples;
+		float outputPeak;
+		bool alignLatency, adaptive, bypassed, linking, linked;
+		HostBypass hostBypass;
+		analyzer::Analyzer aliasAnalyzer;
+		governor::Governor cpuGovernor;
+#if PROFILER_ENABLED
+		profiler::Profiler cpuProfiler;
+		std::vector<int> nodeStages;
+		int stageTotal, stageUp, stageDown;
+#endif
+
+		/*
+		* what depends on the upsampled rate. runs on the audio thread when the oversampling settings change,
+		* sized by prepareToPlay for every setting, so it doesn't allocate
+		*/
+		void prepareSection()
+		{
+			const auto sampleRateUp = oversampling.getSampleRateUpsampled();
+			const auto factor = sampleRateUp / Fs;
+			factorUp = factor;
+			aliasAnalyzer.prepareToPlay(sampleRateUp, Fs);
+
+			auto sectionLatency = hasSection() ? oversampling.getLatencyFractional() : 0.;
+			latencyFractional = 0.;
+			for (auto n = 0; n < nodes.size(); ++n)
+			{
+				auto& node = nodes[n];
+				const auto oversampled = n >= sectionStart && n < sectionEnd;
+				node.rate = oversampled ? Rate::Oversampled : Rate::Base;
+				if (oversampled)
+					node.prepare(sampleRateUp, blockSizeUpMax);
+				if (node.getLatency != nullptr)
+				{
+					if (oversampled)
+						sectionLatency += node.getLatency() / factor;
+					else
+						latencyFractional += node.getLatency();
+				}
+			}
+			latencyFractional += sectionLatency;
+
+			bypassDelay.prepare(sectionLatency, blockSizeBase);
+			holdSamples = 0;
+			sectionWarmUpSamples = 0;
+			bypassed = false;
+
+			// linear phase filters and centred delay lines remember twice their latency
+			tailLength = static_cast<int>(std::ceil(2. * latencyFractional)) + blockSizeBase;
+			std::fill(silentSamples.begin(), silentSamples.end(), 0);
+			outputPeak = 0.f;
+			linkedSamples = 0;
+			linked = false;
+
+			if (alignLatency)
+				latency = alignment.prepare(latencyFractional);
+			else
+				latency = static_cast<int>(std::ceil(latencyFractional - oversampling::FractionalDelay<float>::Epsilon));
+			hostBypassDelay.prepare(static_cast<double>(latency), blockSizeBase);
+			warmUpSamples = 0;
+		}
+
+		void processLinked(AudioBuffer& buffer, int numChannelsIn, int numChannelsOut, int numSamples)
+		{
+			if (updateLinked(buffer, numChannelsIn, numSamples))
+			{
+				linkedBuffer.setDataToReferTo(buffer.getArrayOfWritePointers(), 1, numSamples);
+				processChain(linkedBuffer, 1, 1);
+				for (auto ch = 1; ch < buffer.getNumChannels(); ++ch)
+					buffer.copyFrom(ch, 0, buffer, 0, 0, numSamples);
+			}
+			else
+				processChain(buffer, numChannelsIn, numChannelsOut);
+		}
+
+		/* the input delayed by the reported latency, always kept up to date for when the host bypasses */
+		AudioBuffer& delayHostBypass(const AudioBuffer& buffer, int numSamples)
+		{
+			auto& arena = oversampling::ScratchArena::get();
+			const auto numChannels = std::min(buffer.getNumChannels(), static_cast<int>(hostBypassScratch.size()));
+			for (auto ch = 0; ch < numChannels; ++ch)
+				hostBypassScratch[ch] = arena.allocate(static_cast<size_t>(numSamples));
+			hostBypassBuffer.setDataToReferTo(hostBypassScratch.data(), numChannels, numSamples);
+			for (auto ch = 0; ch < numChannels; ++ch)
+				hostBypassBuffer.copyFrom(ch, 0, buffer, ch, 0, numSamples);
+			hostBypassDelay.processBlock(hostBypassBuffer.getArrayOfWritePointers(), numChannels, numSamples);
+			return hostBypassBuffer;
+		}
+
+		void processChain(AudioBuffer& buffer, int numChannelsIn, int numChannelsOut)
+		{
+			const auto numSamples = buffer.getNumSamples();
+			PROFILE_SCOPE(cpuProfiler, stageTotal, numSamples);
+			applyUpdate();
+
+			const auto silent = isInputSilent(buffer, numChannelsIn, numSamples);
+			if (silent && canSkip())
+			{
+				skipBlock(buffer, numSamples);
+				return;
+			}
+
+			for (auto n = 0; n < sectionStart; ++n)
+				processNode(n, buffer, numSamples);
+
+			if (hasSection())
+			{
+				const auto baseRate = cpuGovernor.getTier() == governor::Tier::BaseRate;
+				if (adaptive || baseRate)
+					processSectionAdaptive(buffer, numChannelsIn, numChannelsOut, numSamples, baseRate);
+				else
+					processSection(buffer, numChannelsIn, numChannelsOut, numSamples);
+			}
+
+			for (auto n = sectionEnd; n < nodes.size(); ++n)
+				processNode(n, buffer, numSamples);
+
+			if (alignLatency)
+				alignment.processBlock(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), buffer.getNumSamples());
+
+			// the output only has to be watched while the tail decays
+			if (silent)
+				outputPeak = buffer.getMagnitude(0, numSamples);
+		}
+
+		void processNode(int n, AudioBuffer& buffer, int numSamples)
+		{
+			PROFILE_SCOPE(cpuProfiler, nodeStages[n], numSamples);
+			juce::ignoreUnused(numSamples);
+			nodes[n].process(buffer);
+		}
+
+		void processSection(AudioBuffer& buffer, int numChannelsIn, int numChannelsOut, int numSamples)
+		{
+			AudioBuffer* bufferUp;
+			{
+				PROFILE_SCOPE(cpuProfiler, stageUp, numSamples);
+				bufferUp = oversampling.upsample(buffer, numChannelsIn, numChannelsOut);
+			}
+			for (auto n = sectionStart; n < sectionEnd; ++n)
+				processNode(n, *bufferUp, numSamples);
+			aliasAnalyzer.pushPre(bufferUp->getReadPointer(0), bufferUp->getNumSamples());
+			if (bufferUp != &buffer)
+			{
+				PROFILE_SCOPE(cpuProfiler, stageDown, numSamples);
+				oversampling.downsample(&buffer, numChannelsOut);
+			}
+			aliasAnalyzer.pushPost(buffer.getReadPointer(0), numSamples);
+		}
+
+		void processSectionAdaptive(AudioBuffer& buffer, int numChannelsIn, int numChannelsOut, int numSamples, bool baseRate)
+		{
+			// the delayed dry signal is always kept up to date, so it can be switched to at any time
+			auto& arena = oversampling::ScratchArena::get();
+			const auto numChannels = std::min(buffer.getNumChannels(), static_cast<int>(dryScratch.size()));
+			for (auto ch = 0; ch < numChannels; ++ch)
+				dryScratch[ch] = arena.allocate(static_cast<size_t>(numSamples));
+			dryBuffer.setDataToReferTo(dryScratch.data(), numChannels, numSamples);
+			for (auto ch = 0; ch < numChannels; ++ch)
+				dryBuffer.copyFrom(ch, 0, buffer, ch < numChannelsIn ? ch : 0, 0, numSamples);
+			bypassDelay.processBlock(dryBuffer.getArrayOfWritePointers(), numChannels, numSamples);
+
+			const auto transparent = isSectionTransparent(buffer.getMagnitude(0, numSamples) * PeakHeadroom);
+			holdSamples = transparent ? std::min(holdSamples + numSamples, holdLength) : 0;
+			// nodes that aren't transparent process the dry path as well, just without oversampling
+			const auto dryNeedsNodes = !transparent;
+			auto processedUp = true, processedDry = false;
+
+			if (!bypassed)
+			{
+				processSection(buffer, numChannelsIn, numChannelsOut, numSamples);
+				if (holdSamples == holdLength || baseRate)
+				{
+					processedDry = dryNeedsNodes;
+					if (processedDry)
+						processDry(numSamples);
+					crossfade(buffer.getArrayOfWritePointers(), dryBuffer.getArrayOfReadPointers(), numChannels, numSamples);
+					bypassed = true;
+				}
+			}
+			else if (transparent || baseRate)
+			{
+				sectionWarmUpSamples = 0; // the filters miss this block, the warm up starts over
+				processedUp = false;
+				processedDry = dryNeedsNodes;
+				if (processedDry)
+					processDry(numSamples);
+				for (auto ch = 0; ch < numChannels; ++ch)
+					buffer.copyFrom(ch, 0, dryBuffer, ch, 0, numSamples);
+			}
+			else
+			{ // the filters still hold the signal from before the bypass, see HostBypass::WarmingUp
+				processSection(buffer, numChannelsIn, numChannelsOut, numSamples);
+				processDry(numSamples);
+				processedDry = true;
+				sectionWarmUpSamples = std::min(sectionWarmUpSamples + numSamples, tailLength);
+				if (sectionWarmUpSamples == tailLength)
+				{
+					crossfade(dryBuffer.getArrayOfWritePointers(), buffer.getArrayOfReadPointers(), numChannels, numSamples);
+					bypassed = false;
+					sectionWarmUpSamples = 0;
+				}
+				for (auto ch = 0; ch < numChannels; ++ch)
+					buffer.copyFrom(ch, 0, dryBuffer, ch, 0, numSamples);
+			}
+			// the states that didn't process this block keep up, so they can be switched to at any time
+			if (!processedUp)
+				skipSection(nodes, getNumSamplesUp(numSamples));
+			if (!processedDry)
+				skipSection(dryNodes, numSamples);
+		}
+
+		/* counts the silent samples of each input channel, true if this block is silent */
+		bool isInputSilent(const AudioBuffer& buffer, int numChannelsIn, int numSamples) noexcept
+		{
+			auto silent = true;
+			const auto numChannels = std::min(numChannelsIn, static_cast<int>(silentSamples.size()));
+			for (auto ch = 0; ch < numChannels; ++ch)
+			{
+				if (buffer.getMagnitude(ch, 0, numSamples) < SilenceThreshold)
+					silentSamples[ch] = std::min(silentSamples[ch] + numSamples, tailLength);
+				else
+				{
+					silentSamples[ch] = 0;
+					silent = false;
+				}
+			}
+			// the others are copies of the first one
+			for (auto ch = std::max(numChannels, 1); ch < silentSamples.size(); ++ch)
+				silentSamples[ch] = silentSamples[0];
+			return silent;
+		}
+
+		/*
+		* true if the chain only has to process the first channel this block.
+		* unlinks as soon as any input channel differs, the state it left out is caught up first
+		*/
+		bool updateLinked(const AudioBuffer& buffer, int numChannelsIn, int numSamples) noexcept
+		{
+			if (!linking || buffer.getNumChannels() < 2)
+				return false;
+			auto identical = true;
+			for (auto ch = 1; ch < numChannelsIn; ++ch)
+				identical &= std::memcmp(buffer.getReadPointer(ch), buffer.getReadPointer(0), numSamples * sizeof(float)) == 0;
+			if (!identical)
+			{
+				linkedSamples = 0;
+				if (linked)
+					syncChannels();
+				linked = false;
+				return false;
+			}
+			// until then the other channels might still ring out differently
+			linkedSamples = std::min(linkedSamples + numSamples, tailLength);
+			linked = linkedSamples == tailLength;
+			return linked;
+		}
+
+		void syncChannels() noexcept
+		{
+			oversampling.syncChannels();
+			alignment.syncChannels();
+			bypassDelay.syncChannels();
+			for (const auto& node : nodes)
+				if (node.sync != nullptr)
+					node.sync();
+			for (const auto& node : dryNodes)
+				if (node.sync != nullptr)
+					node.sync();
+		}
+
+		bool canSkip() const noexcept
+		{
+			if (outputPeak >= SilenceThreshold)
+				return false;
+			for (const auto s : silentSamples)
+				if (s < tailLength)
+					return false;
+			return true;
+		}
+
+		/* outputs silence and lets the nodes fast-forward their state */
+		void skipBlock(AudioBuffer& buffer, int numSamples)
+		{
+			buffer.clear();
+			const auto numSamplesUp = getNumSamplesUp(numSamples);
+			for (const auto& node : nodes)
+				if (node.skip != nullptr)
+					node.skip(node.rate == Rate::Oversampled ? numSamplesUp : numSamples);
+			skipSection(dryNodes, numSamples);
+		}
+
+		int getNumSamplesUp(int numSamples) const noexcept
+		{
+			return static_cast<int>(std::rint(static_cast<double>(numSamples) * factorUp));
+		}
+
+		void processDry(int numSamples)
+		{
+			juce::ignoreUnused(numSamples);
+			for (auto n = sectionStart; n < sectionEnd; ++n)
+				if (dryNodes[n].process != nullptr)
+				{
+					PROFILE_SCOPE(cpuProfiler, nodeStages[n], numSamples);
+					dryNodes[n].process(dryBuffer);
+				}
+		}
+
+		void skipSection(const std::vector<Node>& section, int numSamples)
+		{
+			for (auto n = sectionStart; n < sectionEnd; ++n)
+				if (section[n].skip != nullptr)
+					section[n].skip(numSamples);
+		}
+
+		bool isSectionTransparent(float peak) const
+		{
+			for (auto n = sectionStart; n < sectionEnd; ++n)
+				if (nodes[n].isTransparent == nullptr || !nodes[n].isTransparent(peak))
+					return false;
+			return true;
+		}
+
+		/* fades samples into target over the block */
+		static void crossfade(float** samples, const float* const* target, int numChannels, int numSamples) noexcept
+		{
+			const auto inc = 1.f / static_cast<float>(numSamples);
+			for (auto ch = 0; ch < numChannels; ++ch)
+				for (auto s = 0; s < numSamples; ++s)
+				{
+					const auto x = static_cast<float>(s + 1) * inc;
+					samples[ch][s] += x * (target[ch][s] - samples[ch][s]);
+				}
+		}
+	};
+}
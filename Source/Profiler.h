@@ -0,0 +1,229 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+
+/*
+* per stage timing of the audio callback.
+* compiled out in release builds unless PROFILER_ENABLED is defined as 1.
+*/
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED JUCE_DEBUG
+#endif
+
+#if PROFILER_ENABLED
+namespace profiler
+{
+	static constexpr int MaxNumStages = 16;
+	static constexpr int RingSize = 1 << 12;
+	static constexpr int HistorySize = 512;
+	static constexpr int AggregationIntervalMs = 100;
+
+	using Ticks = juce::int64;
+
+	struct Measurement
+	{
+		Ticks ticks;
+		int stage, numSamples;
+	};
+
+	/* single producer (audio thread), single consumer (profiler thread) */
+	struct Ring
+	{
+		Ring() :
+			data(),
+			writeIdx(0),
+			readIdx(0)
+		{}
+		bool push(const Measurement& m) noexcept
+		{
+			const auto w = writeIdx.load(std::memory_order_relaxed);
+			const auto next = (w + 1) & (RingSize - 1);
+			if (next == readIdx.load(std::memory_order_acquire))
+				return false; // full, drop it
+			data[w] = m;
+			writeIdx.store(next, std::memory_order_release);
+			return true;
+		}
+		bool pop(Measurement& m) noexcept
+		{
+			const auto r = readIdx.load(std::memory_order_relaxed);
+			if (r == writeIdx.load(std::memory_order_acquire))
+				return false;
+			m = data[r];
+			readIdx.store((r + 1) & (RingSize - 1), std::memory_order_release);
+			return true;
+		}
+	protected:
+		std::array<Measurement, RingSize> data;
+		std::atomic<int> writeIdx, readIdx;
+	};
+
+	/* durations in ms, load relative to the block's deadline */
+	struct Stats
+	{
+		float min, mean, p99, max, load;
+	};
+
+	struct Profiler :
+		public juce::Thread
+	{
+		Profiler() :
+			juce::Thread("Profiler"),
+			ring(),
+			names(),
+			history(),
+			stats(),
+			statsLock(),
+			csvFile(),
+			csvLock(),
+			Fs(44100.),
+			tickToMs(1000. / static_cast<double>(juce::Time::getHighResolutionTicksPerSecond())),
+			numStages(0),
+			logging(false)
+		{
+			for (auto& h : history)
+				h.reserve(HistorySize);
+			startThread();
+		}
+		~Profiler() override { stopThread(1000); }
+
+		/* call before processing starts, returns the stage's index */
+		int addStage(const juce::String& name)
+		{
+			if (numStages.load() == MaxNumStages)
+				return -1;
+			const auto idx = numStages.load();
+			names[idx] = name;
+			numStages.store(idx + 1);
+			return idx;
+		}
+		void prepareToPlay(double sampleRate) noexcept { Fs = sampleRate; }
+
+		/* audio thread */
+		void push(int stage, Ticks ticks, int numSamples) noexcept
+		{
+			if (stage >= 0)
+				ring.push({ ticks, stage, numSamples });
+		}
+
+		/* message thread */
+		int getNumStages() const noexcept { return numStages.load(); }
+		const juce::String& getName(int stage) const noexcept { return names[stage]; }
+		std::array<Stats, MaxNumStages> getStats() const noexcept
+		{
+			const juce::SpinLock::ScopedLockType lock(statsLock);
+			return stats;
+		}
+		/* appends one row per stage and aggregation to the file */
+		void startLogging(const juce::File& file)
+		{
+			{
+				const juce::ScopedLock lock(csvLock);
+				csvFile = file;
+				csvFile.replaceWithText("time ms,stage,min ms,mean ms,p99 ms,max ms,load\n");
+			}
+			logging.store(true);
+		}
+		void stopLogging() noexcept { logging.store(false); }
+		bool isLogging() const noexcept { return logging.load(); }
+
+	protected:
+		Ring ring;
+		std::array<juce::String, MaxNumStages> names;
+		std::array<std::vector<Measurement>, MaxNumStages> history;
+		std::array<Stats, MaxNumStages> stats;
+		juce::SpinLock statsLock;
+		juce::File csvFile;
+		juce::CriticalSection csvLock;
+		double Fs, tickToMs;
+		std::atomic<int> numStages;
+		std::atomic<bool> logging;
+
+		void run() override
+		{
+			std::vector<float> sorted;
+			sorted.reserve(HistorySize);
+			while (!threadShouldExit())
+			{
+				wait(AggregationIntervalMs);
+
+				Measurement m;
+				while (ring.pop(m))
+				{
+					auto& h = history[m.stage];
+					if (h.size() == HistorySize)
+						h.erase(h.begin());
+					h.push_back(m);
+				}
+
+				std::array<Stats, MaxNumStages> newStats;
+				const auto num = numStages.load();
+				for (auto st = 0; st < num; ++st)
+				{
+					const auto& h = history[st];
+					auto& s = newStats[st];
+					s = { 0.f, 0.f, 0.f, 0.f, 0.f };
+					if (h.empty())
+						continue;
+					sorted.clear();
+					auto sum = 0., load = 0.;
+					for (const auto& e : h)
+					{
+						const auto ms = static_cast<double>(e.ticks) * tickToMs;
+						sorted.push_back(static_cast<float>(ms));
+						sum += ms;
+						load += ms * Fs / (1000. * static_cast<double>(std::max(1, e.numSamples)));
+					}
+					std::sort(sorted.begin(), sorted.end());
+					const auto size = static_cast<int>(sorted.size());
+					s.min = sorted.front();
+					s.max = sorted.back();
+					s.p99 = sorted[std::min(size - 1, size * 99 / 100)];
+					s.mean = static_cast<float>(sum / size);
+					s.load = static_cast<float>(load / size);
+				}
+				{
+					const juce::SpinLock::ScopedLockType lock(statsLock);
+					stats = newStats;
+				}
+				if (logging.load())
+					log(newStats, num);
+			}
+		}
+
+		void log(const std::array<Stats, MaxNumStages>& s, int num)
+		{
+			const auto time = juce::String(juce::Time::getMillisecondCounterHiRes());
+			juce::String rows;
+			for (auto st = 0; st < num; ++st)
+				rows += time + "," + names[st]
+					+ "," + juce::String(s[st].min) + "," + juce::String(s[st].mean)
+					+ "," + juce::String(s[st].p99) + "," + juce::String(s[st].max)
+					+ "," + juce::String(s[st].load) + "\n";
+			const juce::ScopedLock lock(csvLock);
+			csvFile.appendText(rows);
+		}
+	};
+
+	struct ScopedTimer
+	{
+		ScopedTimer(Profiler& p, int _stage, int _numSamples) noexcept :
+			profiler(p),
+			start(juce::Time::getHighResolutionTicks()),
+			stage(_stage),
+			numSamples(_numSamples)
+		{}
+		~ScopedTimer() { profiler.push(stage, juce::Time::getHighResolutionTicks() - start, numSamples); }
+	protected:
+		Profiler& profiler;
+		Ticks start;
+		int stage, numSamples;
+	};
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(p, stage, numSamples) profiler::ScopedTimer PROFILE_CONCAT(profileScope, __LINE__)(p, stage, numSamples)
+#else
+#define PROFILE_SCOPE(p, stage, numSamples)
+#endif
@@ -0,0 +1,120 @@
+#pragma once
+#include "juce_audio_basics/juce_audio_basics.h"
+#include <vector>
+
+namespace dsp
+{
+	/*
+	* turns parameter changes into ramps of one block at a time.
+	* process() returns false while the value is static, so that modules can take their
+	* constant fast path, otherwise data() holds the per-sample values of the block.
+	* prepare it at the rate of the module it feeds, with the biggest block it will get.
+	*/
+	struct Smooth
+	{
+		enum class Type { Linear, Exponential };
+		static constexpr float Epsilon = 1e-5f;
+
+		Smooth(float startValue = 0.f, Type _type = Type::Exponential, float _timeMs = 20.f) :
+			ramp(),
+			table(),
+			Fs(44100.),
+			type(_type),
+			timeMs(_timeMs),
+			value(startValue), target(startValue), inc(0.f),
+			rampLength(1), remaining(0)
+		{}
+
+		void prepareToPlay(double sampleRate, int blockSize)
+		{
+			Fs = sampleRate;
+			makeTable(blockSize);
+			remaining = 0;
+			value = target;
+		}
+
+		bool process(float _target, int numSamples) noexcept
+		{
+			if (_target != target)
+			{
+				target = _target;
+				remaining = rampLength;
+				inc = (target - value) / static_cast<float>(rampLength);
+			}
+			if (remaining == 0 || numSamples == 0)
+				return false;
+			if (numSamples > static_cast<int>(table.size()))
+			{ // bigger than prepared, the ramp can't hold it without allocating on the audio thread
+				jassertfalse;
+				value = target;
+				remaining = 0;
+				return false;
+			}
+
+			if (type == Type::Linear)
+				processLinear(numSamples);
+			else
+				processExponential(numSamples);
+			return true;
+		}
+
+		/* the ramp of the last block that returned true in process() */
+		const float* data() const noexcept { return ramp.data(); }
+		/* the value at the end of the last block */
+		float getValue() const noexcept { return value; }
+		bool isSmoothing() const noexcept { return remaining != 0; }
+	protected:
+		std::vector<float> ramp, table;
+		double Fs;
+		Type type;
+		float timeMs, value, target, inc;
+		int rampLength, remaining;
+
+		void makeTable(int blockSize)
+		{
+			const auto timeSamples = std::max(1., static_cast<double>(timeMs) * .001 * Fs);
+			rampLength = static_cast<int>(timeSamples);
+			ramp.resize(blockSize, value);
+			table.resize(blockSize);
+			if (type == Type::Linear)
+			{ // 1, 2, 3, ...
+				for (auto i = 0; i < blockSize; ++i)
+					table[i] = static_cast<float>(i + 1);
+			}
+			else
+			{ // r^1, r^2, r^3, ... with r chosen to cover 99% of the distance after timeMs
+				const auto r = std::exp(-4.6 / timeSamples);
+				auto rPow = r;
+				for (auto i = 0; i < blockSize; ++i)
+				{
+					table[i] = static_cast<float>(rPow);
+					rPow *= r;
+				}
+			}
+		}
+
+		void processLinear(int numSamples) noexcept
+		{
+			const auto numRamp = std::min(remaining, numSamples);
+			auto r = ramp.data();
+			juce::FloatVectorOperations::copyWithMultiply(r, table.data(), inc, numRamp);
+			juce::FloatVectorOperations::add(r, value, numRamp);
+			juce::FloatVectorOperations::fill(r + numRamp, target, numSamples - numRamp);
+			remaining -= numRamp;
+			value = remaining == 0 ? target : r[numRamp - 1];
+		}
+
+		void processExponential(int numSamples) noexcept
+		{
+			auto r = ramp.data();
+			juce::FloatVectorOperations::copyWithMultiply(r, table.data(), value - target, numSamples);
+			juce::FloatVectorOperations::add(r, target, numSamples);
+			value = r[numSamples - 1];
+			if (std::abs(value - target) < Epsilon)
+			{
+				value = target;
+				remaining = 0;
+			}
+		}
+	};
+}
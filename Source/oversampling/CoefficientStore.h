@@ -0,0 +1,218 @@
+#pragma once
+#include "juce_core/juce_core.h"
+#include "ConvolutionFilter.h"
+#include <memory>
+#include <vector>
+
+namespace oversampling
+{
+	/*
+	* a file of pre-designed fir coefficients, memory mapped read-only.
+	* filters found here are used in place (zero-copy), everything else is designed on the fly.
+	*
+	* layout: Header, numEntries * Entry, then the taps of every entry as floats, each followed by
+	* its polyphase split for upsampling (see ImpulseResponse::getPhases), so that upsampling runs from the mapping too.
+	* every set starts at a multiple of Alignment bytes and is zero padded up to the next one.
+	* checksum is fnv-1a over everything after the header. files with a different magic or version,
+	* a wrong checksum or entries outside of the file are ignored as a whole.
+	* it's a cache in native byte order, not meant to be moved between machines.
+	*
+	* find() may run on the audio thread (prepareToPlay), store() must not, but it may run on several threads at once.
+	* mappings are only ever added, so views handed out earlier stay valid as long as the store lives.
+	*/
+	struct CoefficientStore
+	{
+		using Key = juce::uint64;
+		using Entries = std::vector<std::pair<Key, ImpulseResponse>>;
+
+		static constexpr juce::uint32 Magic = 0x4643534f; // "OSCF"
+		static constexpr juce::uint32 Version = 2; // bump when the layout changes
+		static constexpr size_t Alignment = 64;
+		static_assert(Alignment % (NumLanes * sizeof(float)) == 0, "the views have to be padded to NumLanes");
+		static constexpr Key FNVOffset = 14695981039346656037ull;
+		static constexpr Key FNVPrime = 1099511628211ull;
+
+		struct Header
+		{
+			juce::uint32 magic, version, numEntries, reserved;
+			juce::uint64 checksum, size;
+		};
+		struct Entry
+		{
+			Key key;
+			juce::uint64 offset, phaseOffset; // in bytes from the start of the file
+			juce::uint32 numTaps, reserved;
+		};
+
+		static Key hash(const void* data, size_t numBytes, Key h = FNVOffset) noexcept
+		{
+			const auto bytes = static_cast<const juce::uint8*>(data);
+			for (size_t i = 0; i < numBytes; ++i)
+			{
+				h ^= bytes[i];
+				h *= FNVPrime;
+			}
+			return h;
+		}
+
+		static juce::File getDefaultFile()
+		{
+			return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+				.getChildFile("OversamplingTest").getChildFile("coefficients.bin");
+		}
+
+		CoefficientStore() :
+			mappings(),
+			designed(),
+			lock(),
+			writeLock(),
+			file(getDefaultFile()),
+			entries(nullptr),
+			base(nullptr),
+			numEntries(0)
+		{
+			load(file);
+		}
+
+		/* leaves ir as it is and returns false if key isn't stored */
+		bool find(Key key, ImpulseResponse& ir) const noexcept
+		{
+			const juce::SpinLock::ScopedLockType l(lock);
+			for (auto e = 0; e < numEntries; ++e)
+				if (entries[e].key == key)
+				{
+					ir = makeView(entries[e]);
+					return true;
+				}
+			for (const auto& d : designed)
+				if (d.first == key)
+				{
+					ir = ImpulseResponse(d.second->getData(), d.second->getPhases(), static_cast<int>(d.second->size()));
+					return true;
+				}
+			return false;
+		}
+		bool contains(Key key) const noexcept
+		{
+			ImpulseResponse ir;
+			return find(key, ir);
+		}
+
+		/*
+		* writes the stored entries plus irs to the file and maps it again.
+		* returns false if the file couldn't be written, the store keeps working from memory then.
+		*/
+		bool store(const Entries& irs)
+		{
+			const juce::ScopedLock w(writeLock);
+			Entries all;
+			{
+				const juce::SpinLock::ScopedLockType l(lock);
+				for (auto e = 0; e < numEntries; ++e)
+					all.emplace_back(entries[e].key, makeView(entries[e]));
+			}
+			for (const auto& ir : irs)
+			{
+				auto known = false;
+				for (const auto& a : all)
+					known |= a.first == ir.first;
+				if (!known)
+					all.push_back(ir);
+			}
+
+			const auto tableEnd = sizeof(Header) + all.size() * sizeof(Entry);
+			auto size = align(tableEnd);
+			std::vector<Entry> table;
+			for (const auto& a : all)
+			{
+				const auto phaseOffset = align(size + a.second.size() * sizeof(float));
+				table.push_back({ a.first, size, phaseOffset, static_cast<juce::uint32>(a.second.size()), 0 });
+				size = align(phaseOffset + a.second.getNumPhaseTaps() * 2 * sizeof(float));
+			}
+			juce::MemoryBlock block(size, true);
+			auto bytes = static_cast<char*>(block.getData());
+			if (!table.empty())
+				std::memcpy(bytes + sizeof(Header), table.data(), table.size() * sizeof(Entry));
+			for (size_t e = 0; e < all.size(); ++e)
+			{
+				const auto& ir = all[e].second;
+				std::memcpy(bytes + table[e].offset, ir.getData(), ir.size() * sizeof(float));
+				std::memcpy(bytes + table[e].phaseOffset, ir.getPhases(), ir.getNumPhaseTaps() * 2 * sizeof(float));
+			}
+			const Header header{ Magic, Version, static_cast<juce::uint32>(all.size()), 0,
+				hash(bytes + sizeof(Header), size - sizeof(Header)), size };
+			std::memcpy(bytes, &header, sizeof(Header));
+
+			// a mapped file can't be replaced everywhere, so it's written next to it first
+			file.getParentDirectory().createDirectory();
+			const auto tmp = file.getSiblingFile(file.getFileNameWithoutExtension() + ".tmp");
+			if (tmp.replaceWithData(block.getData(), block.getSize()) && load(tmp.moveFileTo(file) ? file : tmp))
+				return true;
+			keep(irs);
+			return false;
+		}
+	protected:
+		std::vector<std::unique_ptr<juce::MemoryMappedFile>> mappings;
+		std::vector<std::pair<Key, std::unique_ptr<ImpulseResponse>>> designed; // what couldn't be written
+		juce::SpinLock lock;
+		juce::CriticalSection writeLock; // one store() at a time, they share the file
+		juce::File file;
+		const Entry* entries;
+		const char* base;
+		int numEntries;
+
+		static size_t align(size_t n) noexcept { return (n + Alignment - 1) / Alignment * Alignment; }
+
+		ImpulseResponse makeView(const Entry& entry) const noexcept
+		{
+			return { reinterpret_cast<const float*>(base + entry.offset), reinterpret_cast<const float*>(base + entry.phaseOffset), static_cast<int>(entry.numTaps) };
+		}
+
+		/* copies irs into memory, they are never removed, so views of them stay valid too */
+		void keep(const Entries& irs)
+		{
+			for (const auto& ir : irs)
+				if (!contains(ir.first))
+				{
+					auto copy = std::make_unique<ImpulseResponse>(ir.second);
+					const juce::SpinLock::ScopedLockType l(lock);
+					designed.emplace_back(ir.first, std::move(copy));
+				}
+		}
+
+		bool load(const juce::File& f)
+		{
+			if (!f.existsAsFile())
+				return false;
+			auto mapping = std::make_unique<juce::MemoryMappedFile>(f, juce::MemoryMappedFile::readOnly);
+			const auto data = static_cast<const char*>(mapping->getData());
+			const auto size = mapping->getSize();
+			if (data == nullptr || size < sizeof(Header))
+				return false;
+			Header header;
+			std::memcpy(&header, data, sizeof(Header));
+			if (header.magic != Magic || header.version != Version || header.size != size)
+				return false;
+			if (sizeof(Header) + header.numEntries * sizeof(Entry) > size)
+				return false;
+			if (hash(data + sizeof(Header), size - sizeof(Header)) != header.checksum)
+				return false;
+			const auto table = reinterpret_cast<const Entry*>(data + sizeof(Header));
+			for (juce::uint32 e = 0; e < header.numEntries; ++e)
+			{
+				const auto numTaps = static_cast<int>(table[e].numTaps);
+				if (table[e].offset % Alignment != 0 || table[e].phaseOffset % Alignment != 0 || numTaps <= 0
+					|| table[e].offset + padTaps(numTaps) * sizeof(float) > size
+					|| table[e].phaseOffset + getNumPhaseTaps(numTaps) * 2 * sizeof(float) > size)
+					return false;
+			}
+
+			const juce::SpinLock::ScopedLockType l(lock);
+			entries = table;
+			base = data;
+			numEntries = static_cast<int>(header.numEntries);
+			mappings.push_back(std::move(mapping));
+			return true;
+		}
+	};
+}
@@ -1,5 +1,7 @@
 #pragma once
 #include <vector>
+#include <cstring>
+#include "Dispatch.h"
 
 namespace oversampling
 {
@@ -7,33 +9,106 @@ namespace oversampling
 
 	// http://www.dspguide.com/ch16/1.htm
 
+	/*
+	* dot products use NumLanes partial sums, so they vectorize without reassociating floats.
+	* tap sets are zero padded to a multiple of NumLanes, so no remainder loop is needed.
+	*/
+	static constexpr int NumLanes = 16;
+
+	inline int padTaps(int numTaps) noexcept { return (numTaps + NumLanes - 1) / NumLanes * NumLanes; }
+
+	/* numPhaseTaps of the polyphase split of numTaps taps, see ImpulseResponse::getPhases */
+	inline int getNumPhaseTaps(int numTaps) noexcept { return padTaps((numTaps + 1) / 2); }
+
 	struct ImpulseResponse
 	{
 		ImpulseResponse() :
-			data(),
+			data(padTaps(1), 0.f),
+			phaseData(),
+			coefs(data.data()),
+			phases(nullptr),
+			numTaps(1),
 			latency(0)
 		{
-			data.resize(1, 1.f);
+			data[0] = 1.f;
+			makePhases();
 		}
 		ImpulseResponse(const Buffer& _data) :
 			data(_data),
-			latency(static_cast<int>(data.size()) / 2)
+			phaseData(),
+			coefs(nullptr),
+			phases(nullptr),
+			numTaps(static_cast<int>(_data.size())),
+			latency(numTaps / 2)
+		{
+			data.resize(padTaps(numTaps), 0.f);
+			coefs = data.data();
+			makePhases();
+		}
+		/*
+		* refers to coefficients owned by someone else, e.g. a CoefficientStore, without copying them.
+		* they have to be readable and zero up to padTaps(numTaps), _phases up to getNumPhaseTaps(numTaps) * 2
+		*/
+		ImpulseResponse(const float* _coefs, const float* _phases, int _numTaps) :
+			data(),
+			phaseData(),
+			coefs(_coefs),
+			phases(_phases),
+			numTaps(_numTaps),
+			latency(_numTaps / 2)
+		{
+		}
+		ImpulseResponse(const ImpulseResponse& other) :
+			data(other.data),
+			phaseData(other.phaseData),
+			coefs(other.isView() ? other.coefs : data.data()),
+			phases(other.isView() ? other.phases : phaseData.data()),
+			numTaps(other.numTaps),
+			latency(other.latency)
+		{
+		}
+		ImpulseResponse& operator=(const ImpulseResponse& other)
 		{
+			data = other.data;
+			phaseData = other.phaseData;
+			coefs = other.isView() ? other.coefs : data.data();
+			phases = other.isView() ? other.phases : phaseData.data();
+			numTaps = other.numTaps;
+			latency = other.latency;
+			return *this;
 		}
-		float operator[](int i) const noexcept { return data[i]; }
-		const size_t size() const noexcept { return data.size(); }
+		float operator[](int i) const noexcept { return coefs[i]; }
+		const size_t size() const noexcept { return static_cast<size_t>(numTaps); }
+		int getNumTapsPadded() const noexcept { return padTaps(numTaps); }
+		const float* getData() const noexcept { return coefs; }
+		/* polyphase split for upsampling: even taps, then odd taps, getNumPhaseTaps() each, zero padded */
+		const float* getPhases() const noexcept { return phases; }
+		int getNumPhaseTaps() const noexcept { return oversampling::getNumPhaseTaps(numTaps); }
+		bool isView() const noexcept { return data.empty(); }
 
-		Buffer data;
+		Buffer data, phaseData;
+		const float* coefs;
+		const float* phases;
+		int numTaps;
 		int latency;
 
 		void dbg() {
 			juce::String str("IR Len: ");
-			str += juce::String(data.size());
+			str += juce::String(numTaps);
 			str += "\n";
-			for (auto d = latency; d < data.size(); ++d)
-				str += juce::String(data[d]) + "; ";
+			for (auto d = latency; d < numTaps; ++d)
+				str += juce::String(coefs[d]) + "; ";
 			DBG(str);
 		}
+	protected:
+		void makePhases()
+		{
+			const auto numPhaseTaps = getNumPhaseTaps();
+			phaseData.assign(numPhaseTaps * 2, 0.f);
+			for (auto i = 0; i < numTaps; ++i)
+				phaseData[(i % 2) * numPhaseTaps + i / 2] = coefs[i];
+			phases = phaseData.data();
+		}
 	};
 
 	/*
@@ -93,85 +168,102 @@ namespace oversampling
 
 	using IR = ImpulseResponse;
 
+	/* numTaps is padded */
+	inline float dot(const float* x, const float* h, int numTaps) noexcept
+	{
+		float acc[NumLanes] = {};
+		for (auto i = 0; i < numTaps; i += NumLanes)
+			for (auto l = 0; l < NumLanes; ++l)
+				acc[l] += x[i + l] * h[i + l];
+		// pairwise, a serial sum would make every sample wait for NumLanes additions
+		static_assert(NumLanes == 16, "unrolled for 16 lanes");
+		for (auto l = 0; l < 8; ++l)
+			acc[l] += acc[l + 8];
+		for (auto l = 0; l < 4; ++l)
+			acc[l] += acc[l + 4];
+		return (acc[0] + acc[2]) + (acc[1] + acc[3]);
+	}
+
+	/*
+	* the inputs are kept newest first, so that the dot product with the ir runs forwards over both.
+	* a block is processed in chunks: the chunk's inputs are written in front of the history
+	* before any output is computed (no load waits for a store), then the newest numTaps - 1
+	* inputs are moved to where the history starts for the next chunk.
+	* upsampling only keeps the non-zero inputs and convolves them with each phase of the ir.
+	*/
 	struct Convolution
 	{
+		static constexpr int ChunkSize = 64;
+
 		Convolution(const IR& ir) :
-			buffer(),
-			wIdx(0)
+			buffer()
 		{
-			buffer.resize(ir.size(), 0.f);
+			buffer.resize(ChunkSize + ir.getNumTapsPadded(), 0.f);
 		}
 
 		void processBlock(float* audioBuffer, const IR& ir, const int numSamples) noexcept
 		{
-			for (auto s = 0; s < numSamples; ++s)
-			{
-				++wIdx;
-				if (wIdx == ir.size())
-					wIdx = 0;
-				buffer[wIdx] = audioBuffer[s];
-
-				auto y = 0.f;
-				auto rIdx = wIdx;
-				for (auto i = 0; i < ir.size(); ++i)
-				{
-					y += buffer[rIdx] * ir[i];
-					--rIdx;
-					if (rIdx == -1)
-						rIdx = static_cast<int>(ir.size()) - 1;
-				}
-				audioBuffer[s] = y;
-			}
+			Dispatched<&convolveBlock>::get()(audioBuffer, buffer.data(), ir.getData(), static_cast<int>(ir.size()), ir.getNumTapsPadded(), numSamples);
 		}
-		void processBlockUp(float* audioBuffer, const IR& ir, const int numSamples) noexcept
+		/* phases: even taps, then odd taps, numPhaseTaps each, padded */
+		void processBlockUp(float* audioBuffer, const float* phases, int numPhaseTaps, const int numSamples) noexcept
 		{
-			for (auto s = 0; s < numSamples; s += 2)
-			{
-				audioBuffer[s] = processSampleUpEven(audioBuffer[s], ir);
-				audioBuffer[s + 1] = processSampleUpOdd(ir);
-			}
+			Dispatched<&convolveBlockUp>::get()(audioBuffer, buffer.data(), phases, numPhaseTaps, numSamples);
+		}
+		/* processSampleUpOdd has to follow */
+		float processSampleUpEven(const float sample, const float* phases, int numPhaseTaps) noexcept
+		{
+			buffer[ChunkSize - 1] = sample;
+			return dot(buffer.data() + ChunkSize - 1, phases, numPhaseTaps);
+		}
+		float processSampleUpOdd(const float* phases, int numPhaseTaps) noexcept
+		{
+			const auto y = dot(buffer.data() + ChunkSize - 1, phases + numPhaseTaps, numPhaseTaps);
+			advance(buffer.data(), 1, numPhaseTaps);
+			return y;
 		}
-		float processSampleUpEven(const float sample, const IR& ir) noexcept
+	protected:
+		Buffer buffer;
+
+		/* keeps numTaps - 1 inputs, the history behind them has to stay finite for the zero padded taps */
+		static void advance(float* history, int numInputs, int numTaps) noexcept
+		{
+			std::memmove(history + ChunkSize, history + ChunkSize - numInputs, (numTaps - 1) * sizeof(float));
+		}
+
+		static void convolveBlock(float* samples, float* history, const float* ir, int numTaps, int numTapsPadded, int numSamples) noexcept
 		{
-			const auto irSize = static_cast<int>(ir.size());
-			buffer[wIdx] = sample;
-			auto y = 0.f;
-			auto rIdx = wIdx;
-			for (auto i = 0; i < irSize; i += 2)
+			for (auto s0 = 0; s0 < numSamples; s0 += ChunkSize)
 			{
-				y += buffer[rIdx] * ir[i];
-				rIdx -= 2;
-				if (rIdx < 0)
-					rIdx += irSize;
+				const auto n = std::min(ChunkSize, numSamples - s0);
+				const auto smpls = samples + s0;
+				for (auto s = 0; s < n; ++s)
+					history[ChunkSize - 1 - s] = smpls[s];
+				for (auto s = 0; s < n; ++s)
+					smpls[s] = dot(history + ChunkSize - 1 - s, ir, numTapsPadded);
+				advance(history, n, numTaps);
 			}
-			++wIdx;
-			if (wIdx == irSize)
-				wIdx = 0;
-			return y;
 		}
-		float processSampleUpOdd(const IR& ir) noexcept
+		/* samples are zero stuffed, the odd ones are only written */
+		static void convolveBlockUp(float* samples, float* history, const float* phases, int numPhaseTaps, int numSamples) noexcept
 		{
-			const auto irSize = static_cast<int>(ir.size());
-			auto y = 0.f;
-			auto rIdx = wIdx - 1;
-			if (rIdx == -1)
-				rIdx = irSize - 1;
-			buffer[wIdx] = 0.f;
-			for (auto i = 1; i < irSize; i += 2)
+			const auto odd = phases + numPhaseTaps;
+			const auto numInputs = numSamples / 2;
+			for (auto i0 = 0; i0 < numInputs; i0 += ChunkSize)
 			{
-				y += buffer[rIdx] * ir[i];
-				rIdx -= 2;
-				if (rIdx < 0)
-					rIdx += irSize;
+				const auto n = std::min(ChunkSize, numInputs - i0);
+				const auto smpls = samples + i0 * 2;
+				for (auto i = 0; i < n; ++i)
+					history[ChunkSize - 1 - i] = smpls[i * 2];
+				for (auto i = 0; i < n; ++i)
+				{
+					const auto x = history + ChunkSize - 1 - i;
+					smpls[i * 2] = dot(x, phases, numPhaseTaps);
+					smpls[i * 2 + 1] = dot(x, odd, numPhaseTaps);
+				}
+				advance(history, n, numPhaseTaps);
 			}
-			++wIdx;
-			if (wIdx == irSize)
-				wIdx = 0;
-			return y;
 		}
-	protected:
-		Buffer buffer;
-		int wIdx;
 	};
 
 	using Filters = std::vector<Convolution>;
@@ -185,28 +277,42 @@ namespace oversampling
 		{
 			filters.resize(_numChannels, { ir });
 		}
-		int getLatency() const noexcept { return ir.latency; }
-		void processBlockDown(float** audioBuffer, int numSamples) noexcept
+		ConvolutionFilter(int _numChannels, const IR& _ir) :
+			filters(),
+			ir(_ir),
+			numChannels(_numChannels)
+		{
+			filters.resize(_numChannels, { ir });
+		}
+		/* in samples of this filter's rate */
+		double getLatency() const noexcept { return static_cast<double>(ir.latency); }
+		void processBlockDown(float** audioBuffer, int numChannelsIn, int numSamples) noexcept
 		{
-			for (auto ch = 0; ch < this->numChannels; ++ch)
+			for (auto ch = 0; ch < std::min(numChannelsIn, numChannels); ++ch)
 				filters[ch].processBlock(audioBuffer[ch], ir, numSamples);
 		}
-		void processBlockUp(float** audioBuffer, int numSamples) noexcept
+		void processBlockUp(float** audioBuffer, int numChannelsIn, int numSamples) noexcept
+		{
+			for (auto ch = 0; ch < std::min(numChannelsIn, numChannels); ++ch)
+				filters[ch].processBlockUp(audioBuffer[ch], ir.getPhases(), ir.getNumPhaseTaps(), numSamples);
+		}
+		/* copies the state of the first channel to the others */
+		void syncChannels() noexcept
 		{
-			for (auto ch = 0; ch < this->numChannels; ++ch)
-				filters[ch].processBlockUp(audioBuffer[ch], ir, numSamples);
+			for (auto ch = 1; ch < numChannels; ++ch)
+				filters[ch] = filters[0];
 		}
 		float processSampleUpEven(const float sample, const int ch) noexcept
 		{
-			return filters[ch].processSampleUpEven(sample, ir);
+			return filters[ch].processSampleUpEven(sample, ir.getPhases(), ir.getNumPhaseTaps());
 		}
 		float processSampleUpOdd(const int ch) noexcept 
 		{
-			return filters[ch].processSampleUpOdd(ir);
+			return filters[ch].processSampleUpOdd(ir.getPhases(), ir.getNumPhaseTaps());
 		}
 	protected:
 		Filters filters;
-		IR ir;
+		IR ir; // a view, if it's from a CoefficientStore, so upsampling reads its mapped phases
 		int numChannels;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+#include "juce_core/juce_core.h"
+#include <atomic>
+
+/*
+* kernels get compiled for several instruction sets and the best one the cpu supports
+* is picked at runtime, so that one binary uses every machine fully.
+* gcc and clang compile a wrapper per isa with the target attribute and flatten the kernel into it.
+* other compilers only get the baseline the project is built for.
+*/
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define OVERSAMPLING_MULTI_ISA 1
+#define OVERSAMPLING_TARGET(isa) __attribute__((target(isa), flatten))
+#else
+#define OVERSAMPLING_MULTI_ISA 0
+#define OVERSAMPLING_TARGET(isa)
+#endif
+
+namespace oversampling
+{
+	/* from oldest to newest */
+	enum class ISA { Generic, SSE41, AVX2, AVX512, NumISAs };
+	static constexpr int NumISAs = static_cast<int>(ISA::NumISAs);
+
+	inline juce::String toString(ISA isa)
+	{
+		switch (isa)
+		{
+		case ISA::Generic: return "Generic";
+		case ISA::SSE41: return "SSE4.1";
+		case ISA::AVX2: return "AVX2";
+		case ISA::AVX512: return "AVX-512";
+		default: return "";
+		}
+	}
+
+	/* the newest isa this cpu supports that has kernels */
+	inline ISA detectISA()
+	{
+#if OVERSAMPLING_MULTI_ISA
+		if (juce::SystemStats::hasAVX512F() && juce::SystemStats::hasAVX2() && juce::SystemStats::hasFMA3())
+			return ISA::AVX512;
+		if (juce::SystemStats::hasAVX2() && juce::SystemStats::hasFMA3())
+			return ISA::AVX2;
+		if (juce::SystemStats::hasSSE41())
+			return ISA::SSE41;
+#endif
+		return ISA::Generic;
+	}
+
+	namespace dispatch
+	{
+		inline std::atomic<int>& getISAState()
+		{
+			static std::atomic<int> isa(static_cast<int>(detectISA()));
+			return isa;
+		}
+	}
+
+	/* detected once per process */
+	inline ISA getISA() noexcept { return static_cast<ISA>(dispatch::getISAState().load(std::memory_order_relaxed)); }
+	/* for comparing the kernels, never goes beyond what the cpu supports. any thread */
+	inline void forceISA(ISA isa) noexcept
+	{
+		dispatch::getISAState().store(static_cast<int>(std::min(isa, detectISA())));
+	}
+
+	/*
+	* Dispatched<&kernel>::get() returns kernel compiled for getISA().
+	* fetch it once per block, outside of the sample loops.
+	*/
+	template<auto Kernel>
+	struct Dispatched;
+
+	template<typename R, typename... Args, R(*Kernel)(Args...)>
+	struct Dispatched<Kernel>
+	{
+		using Func = R(*)(Args...);
+
+		static Func get() noexcept
+		{
+#if OVERSAMPLING_MULTI_ISA
+			static constexpr Func kernels[NumISAs] = { &generic, &sse41, &avx2, &avx512 };
+			return kernels[static_cast<int>(getISA())];
+#else
+			return &generic;
+#endif
+		}
+	protected:
+		static R generic(Args... args) { return Kernel(args...); }
+#if OVERSAMPLING_MULTI_ISA
+		OVERSAMPLING_TARGET("sse4.1") static R sse41(Args... args) { return Kernel(args...); }
+		OVERSAMPLING_TARGET("avx2,fma") static R avx2(Args... args) { return Kernel(args...); }
+		OVERSAMPLING_TARGET("avx512f,avx2,fma") static R avx512(Args... args) { return Kernel(args...); }
+#endif
+	};
+}
@@ -0,0 +1,411 @@
+#pragma once
+#include "juce_audio_basics/juce_audio_basics.h"
+#include "ConvolutionFilter.h"
+#include "IIRFilter.h"
+#include "PolynomialFilter.h"
+#include "FIRDesign.h"
+#include "Resampler.h"
+#include "CoefficientStore.h"
+#include "ScratchArena.h"
+
+namespace oversampling
+{
+	constexpr size_t MaxNumStages = 3;
+	static constexpr size_t MaxOrder = 1 << MaxNumStages;
+
+	/* hermite and lagrange are the cheap draft filters, see PolynomialFilter.h */
+	enum class FilterType { IIR, FIR, Hermite, Lagrange };
+	/* blackman is makeSincFilter2, the others reach attenuationDb, see FIRDesign.h */
+	enum class FIRDesign { Blackman, Kaiser, Equiripple };
+
+	/*
+	* filter of one 2x stage.
+	* cutoff and bandwidth are normalized to the stage's upsampled rate (FIR only)
+	*/
+	struct StageSpec
+	{
+		FilterType type;
+		float cutoff, bandwidth;
+		FIRDesign design = FIRDesign::Blackman;
+		float attenuationDb = 0.f;
+	};
+
+	/* bump when a design changes its output, so that stored coefficients aren't used anymore */
+	static constexpr juce::uint32 DesignVersion = 2;
+
+	inline CoefficientStore::Key makeStageKey(const StageSpec& spec, bool upsampling) noexcept
+	{
+		const juce::uint32 ints[] = { DesignVersion, static_cast<juce::uint32>(spec.design), upsampling ? 1u : 0u };
+		const float floats[] = { spec.cutoff, spec.bandwidth, spec.attenuationDb };
+		return CoefficientStore::hash(floats, sizeof(floats), CoefficientStore::hash(ints, sizeof(ints)));
+	}
+
+	/* designs the filter, unless store already has it */
+	inline ImpulseResponse makeStageFilter(const StageSpec& spec, bool upsampling, const CoefficientStore* store = nullptr)
+	{
+		if (spec.type != FilterType::FIR)
+			return {};
+		ImpulseResponse ir;
+		if (store != nullptr && store->find(makeStageKey(spec, upsampling), ir))
+			return ir;
+		switch (spec.design)
+		{
+		case FIRDesign::Kaiser: return makeKaiserFilter(spec.cutoff, spec.bandwidth, spec.attenuationDb, upsampling);
+		case FIRDesign::Equiripple: return makeEquirippleFilter(spec.cutoff, spec.bandwidth, spec.attenuationDb, upsampling);
+		default: return makeSincFilter2(1.f, spec.cutoff, spec.bandwidth, upsampling);
+		}
+	}
+
+	/*
+	* a list of 2x stages, the first one is closest to the host's rate.
+	* only the first stage has to be steep, later ones can have wide transition bands
+	* because the signal they see is already bandlimited by the stages before.
+	*/
+	struct Config
+	{
+		int numStages;
+		std::array<StageSpec, MaxNumStages> stages;
+	};
+
+	/* 4x, chebyshev iir + windowed sinc */
+	inline Config makeRealtimeConfig()
+	{
+		return { 2, {{
+			{ FilterType::IIR, 0.f, 0.f },
+			{ FilterType::FIR, .125f, .25f }
+		}} };
+	}
+	/* 4x, hermite interpolation. for sessions with lots of instances */
+	inline Config makeDraftConfig()
+	{
+		return { 2, {{
+			{ FilterType::Hermite, 0.f, 0.f },
+			{ FilterType::Hermite, 0.f, 0.f }
+		}} };
+	}
+	/* 8x, steep windowed sinc halfbands. for rendering */
+	inline Config makeOfflineConfig()
+	{
+		return { 3, {{
+			{ FilterType::FIR, .25f, .025f },
+			{ FilterType::FIR, .25f, .2f },
+			{ FilterType::FIR, .25f, .3f }
+		}} };
+	}
+
+	/* designs the firs of config that store doesn't have yet and adds them to irs, for CoefficientStore::store */
+	inline void designMissingFilters(const Config& config, const CoefficientStore& store, CoefficientStore::Entries& irs)
+	{
+		for (auto st = 0; st < config.numStages; ++st)
+			for (const auto upsampling : { true, false })
+			{
+				const auto& spec = config.stages[st];
+				const auto key = makeStageKey(spec, upsampling);
+				if (spec.type == FilterType::FIR && !store.contains(key))
+					irs.emplace_back(key, makeStageFilter(spec, upsampling));
+			}
+	}
+
+	/* 2x up- and downsampling, in place */
+	struct Stage
+	{
+		Stage(int _numChannels, const StageSpec& _spec, const CoefficientStore* store = nullptr) :
+			spec(_spec),
+			firUp(_spec.type == FilterType::FIR ? _numChannels : 0, makeStageFilter(_spec, true, store)),
+			firDown(_spec.type == FilterType::FIR ? _numChannels : 0, makeStageFilter(_spec, false, store)),
+			iirUp(_spec.type == FilterType::IIR ? _numChannels : 0),
+			iirDown(_spec.type == FilterType::IIR ? _numChannels : 0),
+			polyUp(isPolynomial(_spec) ? _numChannels : 0, getNumPoints(_spec)),
+			polyDown(isPolynomial(_spec) ? _numChannels : 0, getNumPoints(_spec))
+		{}
+
+		/* samples must have room for numSamples * 2 */
+		void upsample(float** samples, int numChannels, int numSamples) noexcept
+		{
+			if (isPolynomial(spec))
+				return polyUp.upsample(samples, numChannels, numSamples);
+			const auto numSamplesUp = numSamples * 2;
+			// zero stuffing. the iir has unity gain, so the stuffing makes up for the lost energy
+			const auto gain = spec.type == FilterType::IIR ? 2.f : 1.f;
+			const auto stuff = Dispatched<&zeroStuff>::get();
+			for (auto ch = 0; ch < numChannels; ++ch)
+				stuff(samples[ch], numSamples, gain);
+			if (spec.type == FilterType::IIR)
+				iirUp.processBlock(samples, numChannels, numSamplesUp);
+			else
+				firUp.processBlockUp(samples, numChannels, numSamplesUp);
+		}
+		/* numSamples at the upsampled rate */
+		void downsample(float** samples, int numChannels, int numSamples) noexcept
+		{
+			if (isPolynomial(spec))
+				return polyDown.downsample(samples, numChannels, numSamples);
+			if (spec.type == FilterType::IIR)
+				iirDown.processBlock(samples, numChannels, numSamples);
+			else
+				firDown.processBlockDown(samples, numChannels, numSamples);
+			const auto decim = Dispatched<&decimate>::get();
+			for (auto ch = 0; ch < numChannels; ++ch)
+				decim(samples[ch], numSamples / 2);
+		}
+		/* of up- and downsampling filter in samples of the upsampled rate */
+		double getLatency() const noexcept
+		{
+			if (spec.type == FilterType::IIR)
+				return iirUp.getLatency() + iirDown.getLatency();
+			if (isPolynomial(spec))
+				return polyUp.getLatency() + polyDown.getLatency();
+			return firUp.getLatency() + firDown.getLatency();
+		}
+		/* copies the state of the first channel to the others */
+		void syncChannels() noexcept
+		{
+			firUp.syncChannels();
+			firDown.syncChannels();
+			iirUp.syncChannels();
+			iirDown.syncChannels();
+			polyUp.syncChannels();
+			polyDown.syncChannels();
+		}
+	protected:
+		StageSpec spec;
+		ConvolutionFilter firUp, firDown;
+		LowkeyChebyshevFilter<float> iirUp, iirDown;
+		PolynomialFilter polyUp, polyDown;
+
+		static bool isPolynomial(const StageSpec& s) noexcept { return s.type == FilterType::Hermite || s.type == FilterType::Lagrange; }
+		static int getNumPoints(const StageSpec& s) noexcept { return s.type == FilterType::Lagrange ? 6 : 4; }
+
+		static void zeroStuff(float* up, int numSamples, float gain) noexcept
+		{
+			for (auto s = numSamples - 1; s > -1; --s)
+			{
+				const auto s2 = s * 2;
+				up[s2] = up[s] * gain;
+				up[s2 + 1] = 0.f;
+			}
+		}
+		static void decimate(float* samples, int numSamplesDown) noexcept
+		{
+			for (auto s = 0; s < numSamplesDown; ++s)
+				samples[s] = samples[s * 2];
+		}
+	};
+
+	/*
+	* group delay of config's stages in samples of the input's rate, without preparing an engine.
+	* firs that aren't in store get designed, so on the audio thread they have to be stored ahead of time
+	*/
+	inline double getLatencyFractional(const Config& config, const CoefficientStore* store = nullptr)
+	{
+		auto latency = 0.;
+		auto factor = 1.;
+		for (auto st = 0; st < config.numStages; ++st)
+		{
+			factor *= 2.;
+			latency += Stage(1, config.stages[st], store).getLatency() / factor;
+		}
+		return latency;
+	}
+
+
+	/*
+	* oversamples blocks by the 2x stages of a config, or resamples them to a fixed internal rate.
+	* it doesn't know about the host, so a chain can have an engine per section, each with its own factor,
+	* and other tools can use it on its own.
+	* process() upsamples, lets a callback process the upsampled block and downsamples into the block again.
+	* the upsampled block lives in the calling thread's ScratchArena, prepare reserves it, so processing doesn't allocate.
+	*/
+	struct Engine
+	{
+		using AudioBuffer = juce::AudioBuffer<float>;
+
+		Engine(const Config& _config = makeRealtimeConfig()) :
+			buffer(),
+			scratch(),
+			stages(),
+			config(_config),
+			resampler(),
+			Fs(0.), FsUp(0.),
+			internalRate(0.),
+			numChannels(0), blockSize(0), blockSizeUp(0),
+			numSamples1x(0), numSamplesUp(0)
+		{}
+		Engine(const Engine& e) :
+			buffer(),
+			scratch(e.scratch),
+			stages(e.stages),
+			config(e.config),
+			resampler(e.resampler),
+			Fs(e.Fs), FsUp(e.FsUp),
+			internalRate(e.internalRate),
+			numChannels(e.numChannels), blockSize(e.blockSize), blockSizeUp(e.blockSizeUp),
+			numSamples1x(0), numSamplesUp(0)
+		{}
+
+		/* call prepare afterwards */
+		void setConfig(const Config& c) noexcept { config = c; }
+		/* processes at a fixed rate by resampling with an arbitrary ratio, 0 goes back to the stages. call prepare afterwards */
+		void setInternalRate(double rate) noexcept { internalRate = rate; }
+		/* firs found in store are used from there instead of being designed */
+		void prepare(double sampleRate, int maxBlockSize, int _numChannels, const CoefficientStore* store = nullptr)
+		{
+			Fs = sampleRate;
+			blockSize = maxBlockSize;
+			numChannels = _numChannels;
+			scratch.assign(numChannels, nullptr);
+			stages.clear();
+			for (auto st = 0; st < config.numStages; ++st)
+				stages.emplace_back(numChannels, config.stages[st], store);
+
+			if (isFixedRate())
+			{
+				resampler.prepare(sampleRate, internalRate, blockSize, numChannels);
+				FsUp = internalRate;
+				blockSizeUp = resampler.getMaxNumSamplesUp(blockSize);
+			}
+			else
+			{
+				FsUp = sampleRate * static_cast<double>(getUpsamplingFactor());
+				blockSizeUp = blockSize * getUpsamplingFactor();
+			}
+			ScratchArena::reserve(getScratchSize());
+		}
+
+		/*
+		* upsamples block, calls callback(AudioBuffer& blockUp) and downsamples blockUp into block.
+		* blockUp has as many channels as block, up to the prepared number of channels
+		*/
+		template<typename Callback>
+		void process(AudioBuffer& block, Callback&& callback)
+		{
+			const ScratchArena::Frame frame;
+			const auto numChannelsBlock = std::min(block.getNumChannels(), numChannels);
+			callback(upsample(block, numChannelsBlock, numChannelsBlock));
+			downsample(block, numChannelsBlock);
+		}
+
+		/*
+		* the two halves of process, for when the processing can't be wrapped into a callback.
+		* the upsampled block is valid until the ScratchArena::Frame it was made in closes,
+		* so upsample, the processing and downsample have to happen inside of the same one.
+		* it has numChannelsOut channels, the first one is copied to the others numChannelsIn doesn't cover.
+		* the filters of channels beyond numChannelsOut are left alone, see syncChannels
+		*/
+		AudioBuffer& upsample(const AudioBuffer& input, int numChannelsIn, int numChannelsOut)
+		{
+			numSamples1x = input.getNumSamples();
+			allocateScratch(numSamples1x);
+			const auto numChannelsUp = std::min(numChannels, numChannelsOut);
+			if (isFixedRate())
+			{
+				numSamplesUp = resampler.upsample(input.getArrayOfReadPointers(), scratch.data(), numChannelsIn, numSamples1x);
+				buffer.setDataToReferTo(scratch.data(), numChannelsUp, numSamplesUp);
+				if (numChannelsIn < numChannelsOut)
+					juce::FloatVectorOperations::copy(buffer.getWritePointer(1), buffer.getReadPointer(0), numSamplesUp);
+				return buffer;
+			}
+			numSamplesUp = numSamples1x * getUpsamplingFactor();
+
+			buffer.setDataToReferTo(scratch.data(), numChannelsUp, numSamplesUp);
+			auto samplesUp = buffer.getArrayOfWritePointers();
+			const auto samplesIn = input.getArrayOfReadPointers();
+			for (auto ch = 0; ch < numChannelsIn; ++ch)
+				juce::FloatVectorOperations::copy(samplesUp[ch], samplesIn[ch], numSamples1x);
+
+			auto numSamples = numSamples1x;
+			for (auto& stage : stages)
+			{
+				stage.upsample(samplesUp, numChannelsIn, numSamples);
+				numSamples *= 2;
+			}
+			if (numChannelsIn < numChannelsOut)
+				juce::FloatVectorOperations::copy(samplesUp[1], samplesUp[0], numSamplesUp);
+			return buffer;
+		}
+		void downsample(AudioBuffer& output, int numChannelsOut) noexcept
+		{
+			auto samplesUp = buffer.getArrayOfWritePointers();
+			auto samplesOut = output.getArrayOfWritePointers();
+			const auto numChannelsDown = std::min(numChannels, buffer.getNumChannels());
+			if (isFixedRate())
+				return resampler.downsample(samplesUp, numSamplesUp, samplesOut, std::min(numChannelsDown, numChannelsOut), numSamples1x);
+			auto numSamples = numSamplesUp;
+			for (auto st = static_cast<int>(stages.size()) - 1; st > -1; --st)
+			{
+				stages[st].downsample(samplesUp, numChannelsDown, numSamples);
+				numSamples /= 2;
+			}
+			if (numChannelsOut == buffer.getNumChannels())
+				for (auto ch = 0; ch < numChannelsDown; ++ch)
+					juce::FloatVectorOperations::copy(samplesOut[ch], samplesUp[ch], numSamples1x);
+			else
+			{
+				juce::FloatVectorOperations::copy(samplesOut[0], samplesUp[0], numSamples1x);
+				if (numChannelsOut == 2)
+					juce::FloatVectorOperations::copy(samplesOut[1 % numChannelsOut], samplesUp[1], numSamples1x);
+			}
+		}
+		/* copies the filter states of the first channel to the others, for when they were left out for a while */
+		void syncChannels() noexcept
+		{
+			for (auto& stage : stages)
+				stage.syncChannels();
+			resampler.syncChannels();
+		}
+
+		double getSampleRate() const noexcept { return Fs; }
+		double getSampleRateUpsampled() const noexcept { return FsUp; }
+		int getBlockSizeUp() const noexcept { return blockSizeUp; }
+		int getNumChannels() const noexcept { return numChannels; }
+		const Config& getConfig() const noexcept { return config; }
+		bool isFixedRate() const noexcept { return internalRate != 0.; }
+		/* group delay of all filters in samples of the input's rate, can be fractional */
+		double getLatencyFractional() const noexcept
+		{
+			if (isFixedRate())
+				return static_cast<double>(resampler.getLatency());
+			auto latency = 0.;
+			auto factor = 1.;
+			for (const auto& stage : stages)
+			{
+				factor *= 2.;
+				latency += stage.getLatency() / factor;
+			}
+			return latency;
+		}
+		int getLatency() const noexcept { return static_cast<int>(std::ceil(getLatencyFractional())); }
+		int getUpsamplingFactor() const noexcept { return 1 << config.numStages; }
+		/* floats upsample() takes from the ScratchArena per block, see ScratchArena::reserve */
+		size_t getScratchSize() const noexcept
+		{
+			return static_cast<size_t>(numChannels) * ScratchArena::getSize(getNumSamplesScratch(blockSize));
+		}
+	protected:
+		AudioBuffer buffer; // refers to scratch
+		std::vector<float*> scratch;
+		std::vector<Stage> stages;
+		Config config;
+		Resampler resampler;
+
+		double Fs, FsUp, internalRate;
+		int numChannels, blockSize, blockSizeUp;
+		int numSamples1x, numSamplesUp;
+
+		/* room per channel, the stages upsample in place */
+		int getNumSamplesScratch(int numSamples) const noexcept
+		{
+			if (isFixedRate())
+				return resampler.getMaxNumSamplesUp(numSamples);
+			return numSamples * getUpsamplingFactor();
+		}
+
+		void allocateScratch(int numSamples)
+		{
+			auto& arena = ScratchArena::get();
+			const auto numSamplesScratch = static_cast<size_t>(getNumSamplesScratch(numSamples));
+			for (auto& s : scratch)
+				s = arena.allocate(numSamplesScratch);
+		}
+	};
+}
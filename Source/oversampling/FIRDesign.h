@@ -0,0 +1,299 @@
+#pragma once
+#include "ConvolutionFilter.h"
+#include <cmath>
+
+namespace oversampling
+{
+	/*
+	* lowpass designs with an attenuation parameter, alternatives to makeSincFilter2.
+	* all frequencies are normalized to the filter's rate, the transition band is fc +- bw / 2.
+	* the lengths are odd, so that the latency stays an integer.
+	*/
+	namespace design
+	{
+		static constexpr double Pi = 3.14159265358979;
+		static constexpr double Tau = Pi * 2.;
+		/* the equiripple design allows this much more ripple in the passband than in the stopband */
+		static constexpr double PassbandRippleRatio = 10.;
+		/* narrower transition bands are clamped to this, the estimates would overflow otherwise */
+		static constexpr float MinBandwidth = 1e-4f;
+		static constexpr int MaxNumTaps = 4095;
+		/* lengths tried after the estimate, before a design gives up on attenuationDb */
+		static constexpr int MaxNumAttempts = 8;
+
+		inline double dbToGain(double db) noexcept { return std::pow(10., db / 20.); }
+
+		inline int makeOdd(int n) noexcept { return n % 2 == 0 ? n + 1 : n; }
+
+		inline void normalize(Buffer& ir, bool upsampling)
+		{
+			const auto targetGain = upsampling ? 2.f : 1.f;
+			auto sum = 0.f;
+			for (const auto n : ir)
+				sum += n;
+			const auto sumInv = targetGain / sum;
+			for (auto& n : ir)
+				n *= sumInv;
+		}
+
+		/* zeroth order modified bessel function of the first kind */
+		inline double besselI0(double x) noexcept
+		{
+			auto sum = 1., term = 1.;
+			const auto xHalfSq = x * x * .25;
+			for (auto k = 1; k < 64 && term > sum * 1e-12; ++k)
+			{
+				term *= xHalfSq / static_cast<double>(k * k);
+				sum += term;
+			}
+			return sum;
+		}
+
+		/* m taps minus one, limited to [3, MaxNumTaps] */
+		inline int toNumTaps(double m) noexcept
+		{
+			return makeOdd(static_cast<int>(std::ceil(juce::jlimit(2., static_cast<double>(MaxNumTaps - 2), m))) + 1);
+		}
+
+		/* kaiser's estimate */
+		inline int estimateNumTapsKaiser(float bw, float attenuationDb) noexcept
+		{
+			jassert(bw > 0.f);
+			bw = std::max(bw, MinBandwidth);
+			return toNumTaps((static_cast<double>(attenuationDb) - 7.95) / (14.36 * static_cast<double>(bw)));
+		}
+
+		/* herrmann's estimate for the ripples used by makeEquirippleFilter */
+		inline int estimateNumTapsEquiripple(float bw, float attenuationDb) noexcept
+		{
+			jassert(bw > 0.f);
+			bw = std::max(bw, MinBandwidth);
+			const auto dS = dbToGain(-attenuationDb);
+			const auto dP = dS * PassbandRippleRatio;
+			return toNumTaps((-20. * std::log10(std::sqrt(dP * dS)) - 13.) / (14.6 * static_cast<double>(bw)));
+		}
+
+		/* peak magnitude of ir in [from, .5], relative to its dc gain */
+		inline double getStopbandPeak(const Buffer& ir, double from, int numPoints = 1024)
+		{
+			auto dc = 0.;
+			for (const auto n : ir)
+				dc += n;
+			auto peak = 0.;
+			for (auto i = 0; i <= numPoints; ++i)
+			{
+				const auto f = from + (.5 - from) * static_cast<double>(i) / static_cast<double>(numPoints);
+				auto re = 0., im = 0.;
+				for (auto n = 0; n < ir.size(); ++n)
+				{
+					re += ir[n] * std::cos(Tau * f * n);
+					im -= ir[n] * std::sin(Tau * f * n);
+				}
+				peak = std::max(peak, std::sqrt(re * re + im * im));
+			}
+			return peak / std::abs(dc);
+		}
+
+		/*
+		* remez exchange for a type 1 lowpass of numTaps (odd) taps.
+		* passband [0, fPass] wants 1, stopband [fStop, .5] wants 0 and is weighted by stopWeight.
+		*/
+		inline Buffer remezLowpass(int numTaps, double fPass, double fStop, double stopWeight)
+		{
+			const auto L = (numTaps - 1) / 2;
+			const auto r = L + 1; // cosine basis functions, the extremal set has r + 1 points
+			const auto gridSize = 16 * r;
+			const auto widthPass = fPass, widthStop = .5 - fStop;
+			const auto numPass = std::max(2, static_cast<int>(std::round(gridSize * widthPass / (widthPass + widthStop))));
+			const auto numStop = std::max(2, gridSize - numPass);
+			const auto numGrid = numPass + numStop;
+
+			std::vector<double> grid(numGrid), desired(numGrid), weight(numGrid), err(numGrid);
+			for (auto i = 0; i < numPass; ++i)
+			{
+				grid[i] = fPass * i / (numPass - 1);
+				desired[i] = 1.;
+				weight[i] = 1.;
+			}
+			for (auto i = 0; i < numStop; ++i)
+			{
+				grid[numPass + i] = fStop + widthStop * i / (numStop - 1);
+				desired[numPass + i] = 0.;
+				weight[numPass + i] = stopWeight;
+			}
+
+			std::vector<int> ext(r + 1), extNew;
+			for (auto k = 0; k <= r; ++k)
+				ext[k] = k * (numGrid - 1) / r;
+			std::vector<double> x(r + 1), ad(r + 1), y(r + 1);
+			extNew.reserve(numGrid);
+
+			// barycentric interpolation through the extremal points
+			const auto interpolate = [&](double xc)
+			{
+				auto numer = 0., denom = 0.;
+				for (auto k = 0; k <= r; ++k)
+				{
+					const auto d = xc - x[k];
+					if (std::abs(d) < 1e-12)
+						return y[k];
+					const auto c = ad[k] / d;
+					denom += c;
+					numer += c * y[k];
+				}
+				return numer / denom;
+			};
+
+			for (auto iteration = 0; iteration < 64; ++iteration)
+			{
+				for (auto k = 0; k <= r; ++k)
+					x[k] = std::cos(Tau * grid[ext[k]]);
+				// products taken with a stride, so that they neither over- nor underflow
+				const auto stride = (r - 1) / 15 + 1;
+				for (auto k = 0; k <= r; ++k)
+				{
+					auto denom = 1.;
+					for (auto j = 0; j < stride; ++j)
+						for (auto i = j; i <= r; i += stride)
+							if (i != k)
+								denom *= 2. * (x[k] - x[i]);
+					if (std::abs(denom) < 1e-300)
+						denom = 1e-300;
+					ad[k] = 1. / denom;
+				}
+				auto numer = 0., denom = 0., sign = 1.;
+				for (auto k = 0; k <= r; ++k)
+				{
+					numer += ad[k] * desired[ext[k]];
+					denom += sign * ad[k] / weight[ext[k]];
+					sign = -sign;
+				}
+				const auto delta = numer / denom;
+				sign = 1.;
+				for (auto k = 0; k <= r; ++k)
+				{
+					y[k] = desired[ext[k]] - sign * delta / weight[ext[k]];
+					sign = -sign;
+				}
+
+				for (auto i = 0; i < numGrid; ++i)
+					err[i] = weight[i] * (desired[i] - interpolate(std::cos(Tau * grid[i])));
+
+				// local extrema of the error, the band edges count as well
+				extNew.clear();
+				for (auto i = 0; i < numGrid; ++i)
+				{
+					const auto hasPrev = i != 0 && i != numPass;
+					const auto hasNext = i != numGrid - 1 && i != numPass - 1;
+					const auto e = err[i];
+					const auto isMax = e >= 0. && (!hasPrev || e >= err[i - 1]) && (!hasNext || e >= err[i + 1]);
+					const auto isMin = e <= 0. && (!hasPrev || e <= err[i - 1]) && (!hasNext || e <= err[i + 1]);
+					if (!isMax && !isMin)
+						continue;
+					// the error has to alternate, of two neighbours with the same sign the bigger one stays
+					if (!extNew.empty() && (err[extNew.back()] >= 0.) == (e >= 0.))
+					{
+						if (std::abs(e) > std::abs(err[extNew.back()]))
+							extNew.back() = i;
+					}
+					else
+						extNew.push_back(i);
+				}
+				while (extNew.size() > r + 1)
+				{
+					if (std::abs(err[extNew.front()]) < std::abs(err[extNew.back()]))
+						extNew.erase(extNew.begin());
+					else
+						extNew.pop_back();
+				}
+				if (extNew.size() < r + 1 || extNew == ext)
+					break;
+				ext = extNew;
+			}
+
+			// sample the frequency response and take its inverse dft
+			std::vector<double> A(r);
+			for (auto k = 0; k < r; ++k)
+				A[k] = interpolate(std::cos(Tau * static_cast<double>(k) / static_cast<double>(numTaps)));
+			Buffer ir(numTaps);
+			for (auto n = 0; n < numTaps; ++n)
+			{
+				auto sum = A[0];
+				for (auto k = 1; k < r; ++k)
+					sum += 2. * A[k] * std::cos(Tau * k * (n - L) / static_cast<double>(numTaps));
+				ir[n] = static_cast<float>(sum / static_cast<double>(numTaps));
+			}
+			return ir;
+		}
+	}
+
+	/*
+	* kaiser windowed sinc, the least taps a window can do for attenuationDb.
+	* starts at kaiser's estimate and grows until attenuationDb is reached,
+	* for MaxNumAttempts lengths at most. the last one is returned if it's never reached.
+	*/
+	inline ImpulseResponse makeKaiserFilter(float fc, float bw, float attenuationDb, bool upsampling)
+	{
+		using namespace design;
+		const auto a = static_cast<double>(attenuationDb);
+		const auto beta = a > 50. ? .1102 * (a - 8.7) : a >= 21. ? .5842 * std::pow(a - 21., .4) + .07886 * (a - 21.) : 0.;
+		const auto i0BetaInv = 1. / besselI0(beta);
+		const auto target = dbToGain(-attenuationDb);
+		const auto fStop = std::min(.5, static_cast<double>(fc) + static_cast<double>(bw) * .5);
+
+		Buffer ir;
+		const auto N0 = estimateNumTapsKaiser(bw, attenuationDb);
+		for (auto N = N0; N <= std::min(MaxNumTaps, N0 + 2 * (MaxNumAttempts - 1)); N += 2)
+		{
+			const auto MHalf = static_cast<double>(N - 1) * .5;
+			ir.clear();
+			ir.reserve(N);
+			for (auto n = 0; n < N; ++n)
+			{
+				const auto i = static_cast<double>(n) - MHalf;
+				const auto sinc = i == 0. ? Tau * fc : std::sin(Tau * fc * i) / i;
+				const auto r = i / MHalf;
+				const auto w = besselI0(beta * std::sqrt(std::max(0., 1. - r * r))) * i0BetaInv;
+				ir.emplace_back(static_cast<float>(sinc * w));
+			}
+			if (getStopbandPeak(ir, fStop) <= target)
+			{
+				normalize(ir, upsampling);
+				return ir;
+			}
+		}
+		jassertfalse; // attenuationDb can't be reached, e.g. beyond float precision or MaxNumTaps
+		normalize(ir, upsampling);
+		return ir;
+	}
+
+	/*
+	* parks-mcclellan (remez exchange) lowpass, the fewest taps for a given attenuation.
+	* starts at herrmann's estimate and grows until attenuationDb is reached.
+	* if MaxNumAttempts lengths don't reach it, the remez exchange doesn't converge for these bands,
+	* so it falls back to makeKaiserFilter, which costs more taps but gets there more reliably.
+	*/
+	inline ImpulseResponse makeEquirippleFilter(float fc, float bw, float attenuationDb, bool upsampling)
+	{
+		using namespace design;
+		const auto fPass = static_cast<double>(fc) - static_cast<double>(bw) * .5;
+		const auto fStop = static_cast<double>(fc) + static_cast<double>(bw) * .5;
+		if (bw <= 0.f || fPass <= 0. || fStop >= .5)
+			return makeKaiserFilter(fc, bw, attenuationDb, upsampling);
+		const auto target = dbToGain(-attenuationDb);
+
+		const auto N0 = estimateNumTapsEquiripple(bw, attenuationDb);
+		if (N0 == MaxNumTaps) // too narrow for any length that could be tried
+			return makeKaiserFilter(fc, bw, attenuationDb, upsampling);
+		for (auto N = N0; N <= std::min(MaxNumTaps, N0 + 2 * (MaxNumAttempts - 1)); N += 2)
+		{
+			auto ir = remezLowpass(N, fPass, fStop, PassbandRippleRatio);
+			if (getStopbandPeak(ir, fStop) <= target)
+			{
+				normalize(ir, upsampling);
+				return ir;
+			}
+		}
+		return makeKaiserFilter(fc, bw, attenuationDb, upsampling);
+	}
+}
@@ -1,5 +1,9 @@
 #pragma once
 #include <array>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "Dispatch.h"
 
 namespace oversampling
 {
@@ -38,9 +42,42 @@ namespace oversampling
 		}
 
 		void processBlock(Float* samples, int numSamples) noexcept
-		{
+		{ // on a local copy the state stays in registers, samples could alias the members
+			auto filter = *this;
 			for (auto s = 0; s < numSamples; ++s)
-				samples[s] = processSample(samples[s]);
+				samples[s] = filter.processSample(samples[s]);
+			*this = filter;
+		}
+		/* group delay at DC in samples */
+		double getGroupDelay() const noexcept
+		{
+			const double num[5] = { a0, a1, a2, a3, a4 };
+			const double den[5] = { 1., -b1, -b2, -b3, -b4 };
+			auto numSum = 0., numMoment = 0., denSum = 0., denMoment = 0.;
+			for (auto k = 0; k < 5; ++k)
+			{
+				numSum += num[k];
+				numMoment += k * num[k];
+				denSum += den[k];
+				denMoment += k * den[k];
+			}
+			return numMoment / numSum - denMoment / denSum;
+		}
+		/* magnitude response at freq, normalized to this filter's rate [0, .5] */
+		double getMagnitude(double freq) const noexcept
+		{
+			const double num[5] = { a0, a1, a2, a3, a4 };
+			const double den[5] = { 1., -b1, -b2, -b3, -b4 };
+			const auto w = 6.28318530718 * freq;
+			auto numRe = 0., numIm = 0., denRe = 0., denIm = 0.;
+			for (auto k = 0; k < 5; ++k)
+			{
+				numRe += num[k] * std::cos(w * k);
+				numIm -= num[k] * std::sin(w * k);
+				denRe += den[k] * std::cos(w * k);
+				denIm -= den[k] * std::sin(w * k);
+			}
+			return std::sqrt((numRe * numRe + numIm * numIm) / (denRe * denRe + denIm * denIm));
 		}
 		Float processSample(Float x0) noexcept
 		{
@@ -242,11 +279,19 @@ namespace oversampling
 			for (auto& filter : filters)
 				filter.makeChebyshev_lp_4pole_fc45_ripl5();
 		}
-		int getLatency() const noexcept { return 0; }
-		void processBlock(Float** audioBuffer, const int numSamples) noexcept
+		/* group delay at DC in samples of this filter's rate */
+		double getLatency() const noexcept { return filters.empty() ? 0. : filters[0].getGroupDelay(); }
+		void processBlock(Float** audioBuffer, int numChannelsIn, const int numSamples) noexcept
 		{
-			for (auto ch = 0; ch < numChannels; ++ch)
-				filters[ch].processBlock(audioBuffer[ch], numSamples);
+			const auto process = Dispatched<&processChannel>::get();
+			for (auto ch = 0; ch < std::min(numChannelsIn, numChannels); ++ch)
+				process(filters[ch], audioBuffer[ch], numSamples);
+		}
+		/* copies the state of the first channel to the others */
+		void syncChannels() noexcept
+		{
+			for (auto ch = 1; ch < numChannels; ++ch)
+				filters[ch] = filters[0];
 		}
 		float processSample(Float sample, int ch) noexcept
 		{
@@ -255,5 +300,176 @@ namespace oversampling
 	protected:
 		Filters filters;
 		int numChannels;
+
+		static void processChannel(Filter& filter, Float* samples, int numSamples) noexcept
+		{
+			filter.processBlock(samples, numSamples);
+		}
+	};
+
+	/*
+	* 1st order thiran allpass. delays by d samples at DC with a flat magnitude response.
+	* d should be in [.5, 1.5) to keep the pole away from the unit circle.
+	*/
+	template<typename Float>
+	struct ThiranAllpass
+	{
+		ThiranAllpass() :
+			a(0.f), x1(0.f), y1(0.f)
+		{}
+		void setDelay(double d) noexcept
+		{
+			a = static_cast<Float>((1. - d) / (1. + d));
+			x1 = y1 = 0.f;
+		}
+		void processBlock(Float* samples, int numSamples) noexcept
+		{
+			for (auto s = 0; s < numSamples; ++s)
+			{
+				const auto x0 = samples[s];
+				const auto y0 = a * (x0 - y1) + x1;
+				x1 = x0;
+				y1 = y0;
+				samples[s] = y0;
+			}
+		}
+	protected:
+		Float a, x1, y1;
+	};
+
+	/*
+	* pads a chain with a fractional group delay to the next integer latency.
+	* delays below .5 samples are padded by an extra sample, see ThiranAllpass.
+	*/
+	template<typename Float>
+	struct FractionalDelay
+	{
+		using Filters = std::vector<ThiranAllpass<Float>>;
+		static constexpr double Epsilon = 1e-6;
+
+		FractionalDelay(int _numChannels = 0) :
+			filters(),
+			delay(0.),
+			numChannels(_numChannels)
+		{
+			filters.resize(numChannels);
+		}
+		/* returns the integer latency of the padded chain */
+		int prepare(double latency)
+		{
+			const auto latencyInt = std::ceil(latency - Epsilon);
+			delay = latencyInt - latency;
+			if (delay < Epsilon)
+				delay = 0.;
+			else if (delay < .5)
+				delay += 1.;
+			for (auto& filter : filters)
+				filter.setDelay(delay);
+			return static_cast<int>(std::rint(latency + delay));
+		}
+		void processBlock(Float** audioBuffer, int numChannelsIn, const int numSamples) noexcept
+		{
+			if (delay == 0.)
+				return;
+			for (auto ch = 0; ch < std::min(numChannelsIn, numChannels); ++ch)
+				filters[ch].processBlock(audioBuffer[ch], numSamples);
+		}
+		/* copies the state of the first channel to the others */
+		void syncChannels() noexcept
+		{
+			for (auto ch = 1; ch < numChannels; ++ch)
+				filters[ch] = filters[0];
+		}
+		double getDelay() const noexcept { return delay; }
+	protected:
+		Filters filters;
+		double delay;
+		int numChannels;
+	};
+
+	/*
+	* delays by an arbitrary amount of samples, can be fractional.
+	* the integer part is read from a ring buffer, the rest goes through a ThiranAllpass.
+	*/
+	template<typename Float>
+	struct DelayLine
+	{
+		using Ring = std::vector<Float>;
+
+		DelayLine(int _numChannels = 0) :
+			rings(),
+			allpasses(),
+			delay(0.),
+			writeIdx(0), mask(0),
+			delayInt(0),
+			numChannels(_numChannels),
+			useAllpass(false)
+		{
+			rings.resize(numChannels);
+			allpasses.resize(numChannels);
+		}
+		void prepare(double _delay, int blockSize)
+		{
+			delay = _delay;
+			delayInt = getDelayInt(delay);
+			const auto delayFrac = delay - static_cast<double>(delayInt);
+			const auto size = getRingSize(delayInt, blockSize);
+			mask = size - 1;
+			writeIdx = 0;
+			for (auto& ring : rings)
+				ring.assign(size, static_cast<Float>(0));
+			for (auto& allpass : allpasses)
+				allpass.setDelay(delayFrac);
+			useAllpass = delayFrac > FractionalDelay<Float>::Epsilon;
+		}
+		/* makes room for delays up to maxDelay, so that preparing for them later doesn't allocate */
+		void reserve(double maxDelay, int blockSize)
+		{
+			const auto size = getRingSize(getDelayInt(maxDelay), blockSize);
+			for (auto& ring : rings)
+				ring.reserve(size);
+		}
+		void processBlock(Float** audioBuffer, int numChannelsIn, const int numSamples) noexcept
+		{
+			for (auto ch = 0; ch < std::min(numChannelsIn, numChannels); ++ch)
+			{
+				auto& ring = rings[ch];
+				auto samples = audioBuffer[ch];
+				for (auto s = 0; s < numSamples; ++s)
+				{
+					const auto w = writeIdx + s;
+					ring[w & mask] = samples[s];
+					samples[s] = ring[(w - delayInt) & mask];
+				}
+				if (useAllpass)
+					allpasses[ch].processBlock(samples, numSamples);
+			}
+			writeIdx = (writeIdx + numSamples) & mask;
+		}
+		/* copies the state of the first channel to the others, the rings have the same size already */
+		void syncChannels() noexcept
+		{
+			for (auto ch = 1; ch < numChannels; ++ch)
+			{
+				rings[ch] = rings[0];
+				allpasses[ch] = allpasses[0];
+			}
+		}
+		double getDelay() const noexcept { return delay; }
+	protected:
+		std::vector<Ring> rings;
+		std::vector<ThiranAllpass<Float>> allpasses;
+		double delay;
+		int writeIdx, mask, delayInt, numChannels;
+		bool useAllpass;
+
+		static int getDelayInt(double d) noexcept { return d < .5 ? 0 : static_cast<int>(std::floor(d - .5)); }
+		static int getRingSize(int dInt, int blockSize) noexcept
+		{
+			auto size = 1;
+			while (size < dInt + blockSize + 1)
+				size <<= 1;
+			return size;
+		}
 	};
 }
\ No newline at end of file
@@ -1,176 +1,174 @@
 #pragma once
 #include "juce_audio_basics/juce_audio_basics.h"
-#include "ConvolutionFilter.h"
-#include "IIRFilter.h"
+#include "juce_events/juce_events.h"
+#include <functional>
+#include <memory>
+#include "Engine.h"
 
 namespace oversampling
 {
-	constexpr size_t MaxNumStages = 2;
-	static constexpr size_t MaxOrder = 1 << MaxNumStages;
-
 	inline juce::String getOversamplingOrderID() { return "oversamplingOrder"; }
 
-	struct Processor
+	/*
+	* the oversampling of a whole plugin. picks the realtime, draft or offline config and runs everything through an Engine.
+	* the output is delayed up to the latency of the slower one of the realtime and offline configs,
+	* so that the latency the host knows about doesn't change when it starts rendering.
+	* when one of the settings changes, a timer on the message thread builds and prepares the engine for them,
+	* then hands it to the audio thread with a pointer exchange, see applyUpdate. the one it replaces
+	* goes back to the message thread to be freed, so the audio thread never designs, allocates or locks for it.
+	*/
+	struct Processor :
+		public juce::Timer
 	{
 		using Flag = std::atomic<bool>;
 		using AudioBuffer = juce::AudioBuffer<float>;
+		static constexpr int UpdateHz = 30;
+
+		/* an engine with the padding for its latency, prepared for one set of settings */
+		struct Prepared
+		{
+			Prepared(int numChannels) :
+				engine(),
+				padding(numChannels),
+				enabled(true), draft(false), offline(false)
+			{}
+
+			Engine engine;
+			DelayLine<float> padding; // up to the latency of the slower config
+			bool enabled, draft, offline;
+		};
 
 		Processor(juce::AudioProcessor* p) :
+			onUpdate(),
 			audioProcessor(p),
 			Fs(0.),
 			numChannels(p->getChannelCountOfBus(false, 0)),
 			blockSize(0),
 
-			buffer(),
-
-			filterUp4(  numChannels, 176400.f, 22050.f, 44100.f, true), //  17 samples
-			filterDown4(numChannels, 176400.f, 22050.f, 44100.f),
-			filterUp2(numChannels),
-			filterDown2(numChannels),
-
-			FsUp(0.),
-			blockSizeUp(0),
+			prepared(std::make_unique<Prepared>(numChannels)),
+			incoming(nullptr), retired(nullptr),
+			configs({ makeRealtimeConfig(), makeOfflineConfig() }),
+			latencies({ -1., -1., -1. }),
+			configLock(),
+			coefficientStore(),
 
 			enabled(true), wannaUpdate(false),
-			enabledTmp(true),
-
-			numSamples1x(0), numSamples2x(0), numSamples4x(0)
+			enabledTmp(true), draftTmp(false),
+			internalRateTmp(0.)
 		{
+			startTimerHz(UpdateHz);
 		}
 
 		Processor(Processor& p) :
+			juce::Timer(),
+			onUpdate(p.onUpdate),
 			audioProcessor(p.audioProcessor),
 			Fs(p.Fs),
 			numChannels(p.numChannels), blockSize(p.blockSize),
-			buffer(p.buffer),
-			filterUp2(p.filterUp2), filterUp4(p.filterUp4),
-			filterDown4(p.filterDown4), filterDown2(p.filterDown2),
-			FsUp(p.FsUp), blockSizeUp(p.blockSizeUp),
+			prepared(std::make_unique<Prepared>(*p.prepared)),
+			incoming(nullptr), retired(nullptr),
+			configs(p.configs),
+			latencies(p.latencies),
+			configLock(),
+			coefficientStore(),
 			enabled(p.enabled.load()),
 			wannaUpdate(p.wannaUpdate.load()),
-			enabledTmp(p.enabledTmp),
-			numSamples1x(0), numSamples2x(0), numSamples4x(0)
+			enabledTmp(p.enabledTmp), draftTmp(p.draftTmp),
+			internalRateTmp(p.internalRateTmp.load())
 		{
+			startTimerHz(UpdateHz);
+		}
+
+		~Processor() override
+		{
+			stopTimer();
+			delete incoming.exchange(nullptr);
+			delete retired.exchange(nullptr);
 		}
 
 		// prepare & params
+		/* the host doesn't process while it prepares, so the latest settings are applied right away */
 		void prepareToPlay(const double sampleRate, const int _blockSize)
 		{
 			Fs = sampleRate;
 			blockSize = _blockSize;
-			if (enabled.load())
-			{
-				FsUp = sampleRate * static_cast<double>(MaxOrder);
-				blockSizeUp = blockSize * MaxOrder;
-			}
-			else
+			wannaUpdate.store(false);
+			delete incoming.exchange(nullptr);
+			delete retired.exchange(nullptr);
+			prepared = makePrepared();
+			enabled.store(prepared->enabled);
+		}
+		/*
+		* audio thread, switches to the engine the message thread prepared for the latest settings, if there is one.
+		* onApply() runs right after, for everything that depends on the upsampled rate, and mustn't allocate either.
+		* returns true if it switched
+		*/
+		template<typename OnApply>
+		bool applyUpdate(OnApply&& onApply) noexcept
+		{
+			if (prepared->offline != audioProcessor->isNonRealtime())
+				wannaUpdate.store(true);
+			if (retired.load() != nullptr) // the one before hasn't been freed yet
+				return false;
+			const auto next = incoming.exchange(nullptr);
+			if (next == nullptr)
+				return false;
+			auto previous = prepared.release();
+			prepared.reset(next);
+			enabled.store(next->enabled);
+			onApply();
+			retired.store(previous);
+			return true;
+		}
+		/*
+		* message thread, frees the engine applyUpdate replaced and builds the one for the latest settings, if they changed.
+		* called by the timer, hosts without a message loop (like the tools) call it themselves
+		*/
+		void update()
+		{
+			if (const auto previous = retired.exchange(nullptr))
 			{
-				FsUp = sampleRate;
-				blockSizeUp = blockSize;
+				delete previous;
+				if (onUpdate != nullptr)
+					onUpdate();
 			}
-			buffer.setSize(numChannels, blockSize * MaxOrder, false, false, false);
+			if (Fs == 0. || !wannaUpdate.exchange(false))
+				return;
+			delete incoming.exchange(makePrepared().release());
 		}
-		/* processing methods */
+		/* message thread, after the audio thread switched to an update, e.g. to report the new latency */
+		std::function<void()> onUpdate;
+		/*
+		* processing methods, see Engine::upsample.
+		* upsample returns &input while the processor is disabled
+		*/
 		AudioBuffer* upsample(AudioBuffer& input, int numChannelsIn, int numChannelsOut)
 		{
-			if (wannaUpdate.load())
-			{
-				enabled.store(enabledTmp);
-				audioProcessor->prepareToPlay(Fs, blockSize);
-				wannaUpdate.store(false);
-				return nullptr;
-			}
 			if (enabled.load())
-			{
-				numSamples1x = input.getNumSamples();
-				numSamples2x = numSamples1x * 2;
-				numSamples4x = numSamples1x * 4;
-
-				buffer.setSize(numChannels, numSamples4x, true, false, true);
-				auto samplesUp = buffer.getArrayOfWritePointers();
-				const auto samplesIn = input.getArrayOfReadPointers();
-				// zero stuffing + filter 2x
-				for (auto ch = 0; ch < numChannelsIn; ++ch)
-				{
-					auto up = samplesUp[ch];
-					const auto in = samplesIn[ch];
-
-					for (auto s = 0; s < numSamples1x; ++s)
-					{
-						const auto s2 = s * 2;
-						up[s2] = in[s];
-						up[s2 + 1] = 0.f;
-					}
-				}
-				filterUp2.processBlock(samplesUp, numSamples2x);
-				// zero stuffing + filter 4x
-				const auto maxSample2x = numSamples2x - 1;
-				for (auto ch = 0; ch < numChannelsIn; ++ch)
-				{
-					auto up = samplesUp[ch];
-
-					for (auto s = maxSample2x; s > -1; --s)
-					{
-						const auto s2 = s * 2;
-						up[s2] = up[s] * 2.f;
-						up[s2 + 1] = 0.f;
-					}
-				}
-				// filter 4x
-				filterUp4.processBlockUp(samplesUp, numSamples4x);
-				if (numChannelsIn < numChannelsOut)
-					juce::FloatVectorOperations::copy(samplesUp[1], samplesUp[0], numSamples4x);
-				return &buffer;
-			}
+				return &prepared->engine.upsample(input, numChannelsIn, numChannelsOut);
 			return &input;
 		}
 		void downsample(AudioBuffer* outBuf, int numChannelsOut) noexcept
 		{
-			auto samplesUp = buffer.getArrayOfWritePointers();
-			auto samplesOut = outBuf->getArrayOfWritePointers();
-			filterDown4.processBlockDown(samplesUp, numSamples4x);
-			for (auto ch = 0; ch < numChannels; ++ch)
-				for (auto s = 0; s < numSamples2x; ++s)
-					samplesUp[ch][s] = samplesUp[ch][s * 2];
-			filterDown2.processBlock(samplesUp, numSamples2x);
-			if (numChannelsOut == buffer.getNumChannels())
-				for (auto ch = 0; ch < numChannels; ++ch)
-					for (auto s = 0; s < numSamples1x; ++s)
-						samplesOut[ch][s] = samplesUp[ch][s * 2];
-			else
-			{
-				{
-					auto sOut = samplesOut[0];
-					const auto sUp = samplesUp[0];
-
-					for (auto s = 0; s < numSamples1x; ++s)
-						sOut[s] = sUp[s * 2];
-				}
-				if(numChannelsOut == 2)
-				{
-					auto sOut = samplesOut[1 % numChannelsOut];
-					const auto sUp = samplesUp[1];
-
-					for (auto s = 0; s < numSamples1x; ++s)
-						sOut[s] = sUp[s * 2];
-				}
-			}
+			prepared->engine.downsample(*outBuf, numChannelsOut);
+			auto& padding = prepared->padding;
+			if (padding.getDelay() != 0.)
+				padding.processBlock(outBuf->getArrayOfWritePointers(), outBuf->getNumChannels(), outBuf->getNumSamples());
 		}
-		bool processBlockEmpty()
+		////////////////////////////////////////
+		/* copies the filter states of the first channel to the others, for when they were left out for a while */
+		void syncChannels() noexcept
 		{
-			if (wannaUpdate.load())
-			{
-				enabled.store(enabledTmp);
-				audioProcessor->prepareToPlay(Fs, blockSize);
-				wannaUpdate.store(false);
-				return true;
-			}
-			return false;
+			prepared->engine.syncChannels();
+			prepared->padding.syncChannels();
 		}
-		////////////////////////////////////////
-		const double getSampleRateUpsampled() const noexcept { return FsUp; }
-		const int getBlockSizeUp() const noexcept { return blockSizeUp; }
-		/* returns true if changing the state was successful */
+		const double getSampleRateUpsampled() const noexcept { return enabled.load() ? prepared->engine.getSampleRateUpsampled() : Fs; }
+		const int getBlockSizeUp() const noexcept { return enabled.load() ? prepared->engine.getBlockSizeUp() : blockSize; }
+		/*
+		* the biggest upsampled block of any setting, without preparing again.
+		* internal rates above MaxOrder times the host's rate only fit the block size they were prepared with
+		*/
+		int getMaxBlockSizeUp() const noexcept { return std::max(blockSize * static_cast<int>(MaxOrder), getBlockSizeUp()); }
 		void setEnabled(const bool e) noexcept
 		{
 			if (enabledTmp != e)
@@ -180,30 +178,130 @@ namespace oversampling
 			}
 		}
 		bool isEnabled() const noexcept { return enabled.load(); }
-		int getLatency() const noexcept
+		/*
+		* trades quality for cpu, see makeDraftConfig. per instance, only while playing in realtime,
+		* rendering offline still uses the offline config
+		*/
+		void setDraft(bool d) noexcept
 		{
-			if (enabled.load())
-				return filterUp2.getLatency() + filterDown2.getLatency() + filterUp4.getLatency() + filterDown4.getLatency();
-			return 0;
+			if (draftTmp != d)
+			{
+				draftTmp = d;
+				wannaUpdate.store(true);
+			}
+		}
+		bool isDraft() const noexcept { return draftTmp; }
+		/*
+		* replaces the stages used in realtime or offline, e.g. with the output of a Planner.
+		* message thread, the firs are designed and the latencies of the configs measured here,
+		* so that neither happens when the engine is built
+		*/
+		void setConfig(const Config& c, bool forOffline)
+		{
+			{
+				const juce::SpinLock::ScopedLockType lock(configLock);
+				configs[forOffline ? 1 : 0] = c;
+			}
+			storeCoefficients();
+			cacheLatencies();
+			wannaUpdate.store(true);
+		}
+		/*
+		* designs the firs of the realtime, offline and draft configs that aren't stored yet and writes them,
+		* so that building an engine, and the next session, maps them instead. message thread.
+		*/
+		void storeCoefficients()
+		{
+			CoefficientStore::Entries irs;
+			for (const auto& cfg : getConfigs())
+				designMissingFilters(cfg, *coefficientStore, irs);
+			if (!irs.empty())
+				coefficientStore->store(irs);
+		}
+		/*
+		* processes at a fixed rate, whatever the host's rate, by resampling with an arbitrary ratio.
+		* 0 goes back to the power of 2 stages. any thread, e.g. from a parameter's automation
+		*/
+		void setInternalRate(double rate) noexcept
+		{
+			if (internalRateTmp.exchange(rate) != rate)
+				wannaUpdate.store(true);
+		}
+		bool isFixedRate() const noexcept { return prepared->engine.isFixedRate(); }
+		/* true while the host renders offline, then the heavier config is used */
+		bool isOffline() const noexcept { return prepared->offline; }
+		/* group delay of all filters plus the padding in samples of the host's rate, can be fractional */
+		double getLatencyFractional() const noexcept
+		{
+			return enabled.load() ? prepared->engine.getLatencyFractional() + prepared->padding.getDelay() : 0.;
+		}
+		int getLatency() const noexcept { return static_cast<int>(std::ceil(getLatencyFractional())); }
+		/* of the slowest setting. the resampler's is only covered for internal rates above the host's rate */
+		double getMaxLatencyFractional() const noexcept
+		{
+			return std::max({ latencies[0], latencies[1], latencies[2], 2. * Resampler::HalfTaps, getLatencyFractional() });
+		}
+		int getUpsamplingFactor() const noexcept { return prepared->engine.getUpsamplingFactor(); }
+		/* floats upsample() takes from the ScratchArena per block, see ScratchArena::reserve */
+		size_t getScratchSize() const noexcept { return prepared->engine.getScratchSize(); }
+		/* the same for getMaxBlockSizeUp(), so that applying an update doesn't grow the arena */
+		size_t getMaxScratchSize() const noexcept
+		{
+			return static_cast<size_t>(numChannels) * ScratchArena::getSize(static_cast<size_t>(getMaxBlockSizeUp()));
 		}
-		static constexpr int getUpsamplingFactor() noexcept { return 4; }
 	protected:
 		juce::AudioProcessor* audioProcessor;
 		double Fs;
 		int numChannels, blockSize;
 
-		AudioBuffer buffer;
+		std::unique_ptr<Prepared> prepared; // the audio thread's
+		std::atomic<Prepared*> incoming, retired;
+		std::array<Config, 2> configs; // realtime, offline
+		std::array<double, 3> latencies; // of the realtime, offline and draft configs, -1 until measured. message thread
+		mutable juce::SpinLock configLock;
+		juce::SharedResourcePointer<CoefficientStore> coefficientStore;
 
-		ConvolutionFilter filterUp4, filterDown4;
-		LowkeyChebyshevFilter<float> filterUp2, filterDown2;
+		Flag enabled, wannaUpdate;
+		bool enabledTmp, draftTmp;
+		std::atomic<double> internalRateTmp;
 
-		double FsUp;
-		int blockSizeUp;
+		void timerCallback() override { update(); }
 
-		Flag enabled, wannaUpdate;
-		bool enabledTmp;
+		/* realtime, offline, draft */
+		std::array<Config, 3> getConfigs() const
+		{
+			const juce::SpinLock::ScopedLockType lock(configLock);
+			return { configs[0], configs[1], makeDraftConfig() };
+		}
+
+		void cacheLatencies()
+		{
+			const auto cfgs = getConfigs();
+			for (auto c = 0; c < 3; ++c)
+				latencies[c] = oversampling::getLatencyFractional(cfgs[c], &coefficientStore.get());
+		}
 
-		int numSamples1x, numSamples2x, numSamples4x;
+		std::unique_ptr<Prepared> makePrepared()
+		{
+			if (latencies[0] < 0.)
+				cacheLatencies();
+			const auto cfgs = getConfigs();
+			auto p = std::make_unique<Prepared>(numChannels);
+			p->enabled = enabledTmp;
+			p->draft = draftTmp;
+			p->offline = audioProcessor->isNonRealtime();
+			const auto realtimeIdx = p->draft ? 2 : 0;
+			auto& engine = p->engine;
+			engine.setConfig(cfgs[p->offline ? 1 : realtimeIdx]);
+			engine.setInternalRate(internalRateTmp.load());
+			engine.prepare(Fs, blockSize, numChannels, &coefficientStore.get());
+
+			auto latency = engine.getLatencyFractional();
+			if (!engine.isFixedRate())
+				latency = std::max(latencies[realtimeIdx], latencies[1]);
+			p->padding.prepare(latency - engine.getLatencyFractional(), blockSize);
+			return p;
+		}
 	};
 }
 
@@ -0,0 +1,361 @@
+#pragma once
+#include "juce_events/juce_events.h"
+#include "Engine.h"
+
+namespace oversampling
+{
+	/*
+	* what the oversampling has to achieve.
+	* passband is normalized to the host's rate, e.g. .45 keeps 19.8khz at 44.1khz intact.
+	* rejectionDb is how much images and aliases that would land in the passband are attenuated.
+	*/
+	struct Requirements
+	{
+		int factor;
+		float passband, rejectionDb;
+
+		bool operator==(const Requirements& other) const noexcept
+		{
+			return factor == other.factor && passband == other.passband && rejectionDb == other.rejectionDb;
+		}
+	};
+
+	/* nanoseconds per multiply-accumulate of each filter family */
+	struct Costs
+	{
+		double fir, iir;
+	};
+
+	/* what Planner::calibrate measured per isa on an x64 desktop cpu, for until this machine is measured */
+	inline Costs getDefaultCosts(ISA isa) noexcept
+	{
+		switch (isa)
+		{
+		case ISA::AVX2:
+		case ISA::AVX512: return { .12, .3 };
+		default: return { .3, .4 };
+		}
+	}
+
+	struct Plan
+	{
+		Config config;
+		double macsPerSample; // per host sample and channel, up and down
+		double estimatedNs; // per host sample and channel
+		bool feasible;
+	};
+
+	/*
+	* finds the cheapest chain of 2x stages that meets the requirements.
+	*
+	* every stage creates images of the passband, starting at its input rate minus the passband.
+	* a stage can leave them to a later one (the iir's cutoff is too high to reject them),
+	* but then the later stage's transition band has to end where the first unrejected images start,
+	* which is narrower relative to its rate and costs more taps. downsampling mirrors this,
+	* since each stage uses the same filter in both directions. the last stage must leave nothing.
+	* all combinations of families are tried, there are at most 2^MaxNumStages of them.
+	* firs are equiripple designs, so any rejection can be met by adding taps.
+	* the iir is always the 4 pole chebyshev, neither its order nor polyphase iirs are searched.
+	*/
+	struct Planner
+	{
+		static constexpr float MaxPassbandDroopDb = 1.f;
+		static constexpr int IIRMacs = 9;
+
+		Planner(const Costs& _costs = getDefaultCosts(getISA())) :
+			costs(_costs),
+			cheby()
+		{
+			cheby.makeChebyshev_lp_4pole_fc45_ripl5();
+		}
+
+		Plan plan(const Requirements& req) const
+		{
+			auto numStages = 0;
+			while ((1 << numStages) < req.factor && numStages < static_cast<int>(MaxNumStages))
+				++numStages;
+
+			Plan best{ {}, 0., 0., false };
+			const auto numCombinations = 1 << numStages;
+			for (auto c = 0; c < numCombinations; ++c)
+			{
+				Plan p{ { numStages, {} }, 0., 0., false };
+				auto edge = std::numeric_limits<double>::infinity(); // lowest unrejected image, host rate
+				auto valid = true;
+				for (auto st = 0; st < numStages; ++st)
+				{
+					const auto rateIn = static_cast<double>(1 << st);
+					const auto rateUp = rateIn * 2.;
+					const auto stop = std::min(edge, rateIn - static_cast<double>(req.passband));
+					auto& spec = p.config.stages[st];
+					if (c & (1 << st))
+					{
+						spec = { FilterType::IIR, 0.f, 0.f };
+						const auto droopDb = gainToDb(cheby.getMagnitude(req.passband / rateUp));
+						if (droopDb < -MaxPassbandDroopDb)
+							valid = false;
+						const auto rejectionDb = -gainToDb(cheby.getMagnitude(std::min(.5, stop / rateUp)));
+						edge = rejectionDb >= req.rejectionDb ? std::numeric_limits<double>::infinity() : stop;
+						p.macsPerSample += 2. * IIRMacs * rateUp;
+						p.estimatedNs += 2. * IIRMacs * rateUp * costs.iir;
+					}
+					else
+					{
+						spec = {
+							FilterType::FIR,
+							static_cast<float>((req.passband + stop) * .5 / rateUp),
+							static_cast<float>((stop - req.passband) / rateUp),
+							FIRDesign::Equiripple,
+							req.rejectionDb
+						};
+						if (spec.bandwidth <= 0.f)
+						{ // the passband reaches into the images
+							valid = false;
+							break;
+						}
+						edge = std::numeric_limits<double>::infinity();
+						// polyphase up: half the taps per sample, down: all of them
+						const auto macs = 1.5 * getNumTaps(spec) * rateUp;
+						p.macsPerSample += macs;
+						p.estimatedNs += macs * costs.fir;
+					}
+				}
+				if (!valid || edge != std::numeric_limits<double>::infinity())
+					continue;
+				p.feasible = true;
+				if (!best.feasible || p.estimatedNs < best.estimatedNs)
+					best = p;
+			}
+			return best;
+		}
+
+		/*
+		* measures the cost of the filter families on this machine, so that plan() weighs them correctly.
+		* the fastest of numRuns counts, the others were interrupted. takes a few milliseconds per run,
+		* don't call it on the audio thread, see Calibration.
+		*/
+		void calibrate(int numRuns = 5)
+		{
+			const StageSpec fir{ FilterType::FIR, .25f, .05f };
+			auto nsFir = std::numeric_limits<double>::infinity();
+			auto nsIir = nsFir;
+			for (auto r = 0; r < numRuns; ++r)
+			{
+				nsFir = std::min(nsFir, measure({ 1, {{ fir }} }));
+				nsIir = std::min(nsIir, measure({ 1, {{ { FilterType::IIR, 0.f, 0.f } }} }));
+			}
+			costs.fir = nsFir / (1.5 * getNumTaps(fir) * 2.);
+			costs.iir = nsIir / (2. * IIRMacs * 2.);
+		}
+
+		/* nanoseconds per host sample and channel for up- and downsampling with config */
+		static double measure(const Config& config, int numBlocks = 64, int blockSize = 256)
+		{
+			std::vector<Stage> stages;
+			for (auto st = 0; st < config.numStages; ++st)
+				stages.emplace_back(1, config.stages[st]);
+			std::vector<float> block(blockSize * MaxOrder, 0.f);
+			auto samples = block.data();
+			juce::Random rand(420);
+
+			auto ticks = static_cast<juce::int64>(0);
+			for (auto b = 0; b < numBlocks; ++b)
+			{
+				for (auto s = 0; s < blockSize; ++s)
+					block[s] = rand.nextFloat() * 2.f - 1.f;
+				const auto start = juce::Time::getHighResolutionTicks();
+				auto numSamples = blockSize;
+				for (auto& stage : stages)
+				{
+					stage.upsample(&samples, 1, numSamples);
+					numSamples *= 2;
+				}
+				for (auto st = config.numStages - 1; st > -1; --st)
+				{
+					stages[st].downsample(&samples, 1, numSamples);
+					numSamples /= 2;
+				}
+				ticks += juce::Time::getHighResolutionTicks() - start;
+			}
+			const auto seconds = juce::Time::highResolutionTicksToSeconds(ticks);
+			return seconds * 1e9 / static_cast<double>(numBlocks * blockSize);
+		}
+
+		const Costs& getCosts() const noexcept { return costs; }
+	protected:
+		Costs costs;
+		IIR<double> cheby;
+
+		static double gainToDb(double g) noexcept { return 20. * std::log10(std::max(g, 1e-12)); }
+		static double getNumTaps(const StageSpec& spec) noexcept
+		{
+			switch (spec.design)
+			{
+			case FIRDesign::Kaiser: return design::estimateNumTapsKaiser(spec.bandwidth, spec.attenuationDb);
+			case FIRDesign::Equiripple: return design::estimateNumTapsEquiripple(spec.bandwidth, spec.attenuationDb);
+			default:
+			{ // see makeSincFilter2
+				auto M = static_cast<int>(4.f / spec.bandwidth);
+				if (M % 2 != 0) M += 1;
+				return static_cast<double>(M + 1);
+			}
+			}
+		}
+	};
+
+	/*
+	* the costs of this machine for all instances of a process, use it as a SharedResourcePointer.
+	* the first one ever calibrates on a background thread and writes the result to a file,
+	* so every later session starts with the measured costs. until then getCosts returns the defaults.
+	* plans run on the same thread, after the calibration, so that neither the designs of their firs
+	* nor writing them happens while a plugin is instantiated.
+	*/
+	struct Calibration :
+		public juce::Thread,
+		public juce::ChangeBroadcaster
+	{
+		Calibration() :
+			juce::Thread("PlannerCalibration"),
+			coefficientStore(),
+			file(getDefaultFile()),
+			requests(),
+			lock(),
+			planned(),
+			fir(0.), iir(0.),
+			calibrated(false)
+		{
+			const auto defaults = getDefaultCosts(getISA());
+			fir.store(defaults.fir);
+			iir.store(defaults.iir);
+			calibrated = load();
+			startThread(juce::Thread::Priority::low);
+		}
+		~Calibration() override { stopThread(1000); }
+
+		static juce::File getDefaultFile()
+		{
+			return CoefficientStore::getDefaultFile().getSiblingFile("costs.txt");
+		}
+
+		/* any thread */
+		Costs getCosts() const noexcept { return { fir.load(), iir.load() }; }
+
+		/*
+		* plans req with the measured costs and stores the firs of its config.
+		* listeners get a change message when it's ready, see getPlan. any thread
+		*/
+		void requestPlan(const Requirements& req)
+		{
+			{
+				const juce::ScopedLock l(lock);
+				for (const auto& r : requests)
+					if (r.requirements == req)
+						return;
+				requests.push_back({ req, {}, false });
+			}
+			notify();
+		}
+		/* false while the plan of req isn't ready. timeoutMs 0 doesn't wait, -1 waits until it is */
+		bool getPlan(const Requirements& req, Plan& plan, int timeoutMs = 0) const
+		{
+			for (;;)
+			{
+				{
+					const juce::ScopedLock l(lock);
+					for (const auto& r : requests)
+						if (r.ready && r.requirements == req)
+						{
+							plan = r.plan;
+							return true;
+						}
+				}
+				if (timeoutMs == 0 || !planned.wait(timeoutMs))
+					return false;
+			}
+		}
+	protected:
+		struct Request
+		{
+			Requirements requirements;
+			Plan plan;
+			bool ready;
+		};
+
+		juce::SharedResourcePointer<CoefficientStore> coefficientStore;
+		juce::File file;
+		std::vector<Request> requests;
+		juce::CriticalSection lock;
+		juce::WaitableEvent planned;
+		std::atomic<double> fir, iir;
+		bool calibrated; // this thread's after the constructor
+
+		/* "isa fir iir", the costs only count for the isa they were measured with */
+		bool load()
+		{
+			juce::StringArray tokens;
+			tokens.addTokens(file.loadFileAsString(), " \n", "");
+			tokens.removeEmptyStrings();
+			if (tokens.size() != 3 || tokens[0] != toString(getISA()))
+				return false;
+			const auto f = tokens[1].getDoubleValue(), i = tokens[2].getDoubleValue();
+			if (f <= 0. || i <= 0.)
+				return false;
+			fir.store(f);
+			iir.store(i);
+			return true;
+		}
+
+		void run() override
+		{
+			if (!calibrated)
+				calibrate();
+			while (!threadShouldExit())
+			{
+				planRequests();
+				wait(-1);
+			}
+		}
+
+		void calibrate()
+		{
+			Planner planner;
+			planner.calibrate();
+			if (threadShouldExit())
+				return;
+			const auto& costs = planner.getCosts();
+			fir.store(costs.fir);
+			iir.store(costs.iir);
+			file.getParentDirectory().createDirectory();
+			file.replaceWithText(toString(getISA()) + " " + juce::String(costs.fir, 6) + " " + juce::String(costs.iir, 6) + "\n");
+			calibrated = true;
+		}
+
+		void planRequests()
+		{
+			for (auto i = 0; !threadShouldExit(); ++i)
+			{
+				Requirements req;
+				{
+					const juce::ScopedLock l(lock);
+					while (i < static_cast<int>(requests.size()) && requests[i].ready)
+						++i;
+					if (i == static_cast<int>(requests.size()))
+						return;
+					req = requests[i].requirements;
+				}
+				const auto plan = Planner(getCosts()).plan(req);
+				CoefficientStore::Entries irs;
+				designMissingFilters(plan.config, *coefficientStore, irs);
+				if (!irs.empty())
+					coefficientStore->store(irs);
+				{
+					const juce::ScopedLock l(lock);
+					requests[i].plan = plan;
+					requests[i].ready = true;
+				}
+				planned.signal();
+				sendChangeMessage();
+			}
+		}
+	};
+}
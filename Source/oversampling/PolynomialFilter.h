@@ -0,0 +1,156 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <algorithm>
+#include "Dispatch.h"
+
+namespace oversampling
+{
+	/*
+	* draft quality 2x filters from polynomial interpolation, a few multiplies per sample.
+	* upsampling keeps every input and fills in the midpoints between them with an interpolator over NumPoints inputs:
+	* 4 is a cubic hermite (catmull-rom), which at the midpoint is the same as 3rd order lagrange,
+	* 6 is 5th order lagrange.
+	* seen as an fir, the interpolator is a linear phase halfband filter, all odd taps but the centre one are 0.
+	* downsampling uses that same filter at half the gain and only computes the samples that are kept.
+	* the 4 point one rejects aliases by about 25db from .75 of nyquist on, the 6 point one by about 45db.
+	*/
+	template<int NumPoints>
+	struct Midpoint;
+
+	template<>
+	struct Midpoint<4>
+	{
+		static constexpr float Weights[4] = { -1.f / 16.f, 9.f / 16.f, 9.f / 16.f, -1.f / 16.f };
+	};
+	template<>
+	struct Midpoint<6>
+	{
+		static constexpr float Weights[6] = { 3.f / 256.f, -25.f / 256.f, 150.f / 256.f, 150.f / 256.f, -25.f / 256.f, 3.f / 256.f };
+	};
+
+	struct PolynomialFilter
+	{
+		static constexpr int MaxNumPoints = 6;
+		static constexpr int ChunkSize = 64; // inputs
+
+		PolynomialFilter(int _numChannels = 0, int _numPoints = 4) :
+			histories(),
+			numPoints(_numPoints),
+			numChannels(_numChannels)
+		{
+			histories.resize(numChannels);
+			for (auto& h : histories)
+				h.fill(0.f);
+		}
+		/* of up- or downsampling, in samples of the upsampled rate */
+		double getLatency() const noexcept { return static_cast<double>(numPoints - 1); }
+		/* numSamples inputs to numSamples * 2 outputs, in place */
+		void upsample(float** samples, int numChannelsIn, int numSamples) noexcept
+		{
+			const auto process = numPoints == 6 ? Dispatched<&interpolate<6>>::get() : Dispatched<&interpolate<4>>::get();
+			for (auto ch = 0; ch < std::min(numChannelsIn, numChannels); ++ch)
+				process(samples[ch], histories[ch].data(), numSamples);
+		}
+		/* numSamples inputs to numSamples / 2 outputs, in place. numSamples is even */
+		void downsample(float** samples, int numChannelsIn, int numSamples) noexcept
+		{
+			const auto process = numPoints == 6 ? Dispatched<&decimate<6>>::get() : Dispatched<&decimate<4>>::get();
+			for (auto ch = 0; ch < std::min(numChannelsIn, numChannels); ++ch)
+				process(samples[ch], histories[ch].data(), numSamples);
+		}
+		/* copies the state of the first channel to the others */
+		void syncChannels() noexcept
+		{
+			for (auto ch = 1; ch < numChannels; ++ch)
+				histories[ch] = histories[0];
+		}
+	protected:
+		/*
+		* upsampling keeps the last NumPoints - 1 inputs.
+		* downsampling keeps the last NumPoints - 1 even and NumPoints / 2 odd inputs, in that order
+		*/
+		using History = std::array<float, 2 * MaxNumPoints>;
+
+		std::vector<History> histories;
+		int numPoints, numChannels;
+
+		/*
+		* the loops always run over whole chunks, a constant trip count vectorizes without remainder loops.
+		* the chunks are processed from the last to the first. each one is copied out before its outputs are written,
+		* which only ever land on inputs of the chunk itself or of ones that are already done.
+		*/
+		template<int NumPoints>
+		static void interpolate(float* samples, float* history, int numSamples) noexcept
+		{
+			static constexpr int NumHistory = NumPoints - 1;
+			const auto& w = Midpoint<NumPoints>::Weights;
+
+			float newHistory[NumHistory];
+			const auto numKept = std::max(0, NumHistory - numSamples);
+			std::copy(history + NumHistory - numKept, history + NumHistory, newHistory);
+			std::copy(samples + numSamples - (NumHistory - numKept), samples + numSamples, newHistory + numKept);
+
+			float x[NumHistory + ChunkSize] = {}, mid[ChunkSize], y[ChunkSize * 2];
+			for (auto i0 = (numSamples - 1) / ChunkSize * ChunkSize; i0 >= 0; i0 -= ChunkSize)
+			{
+				const auto n = std::min(ChunkSize, numSamples - i0);
+				if (i0 == 0)
+					std::copy(history, history + NumHistory, x);
+				else
+					std::copy(samples + i0 - NumHistory, samples + i0, x);
+				std::copy(samples + i0, samples + i0 + n, x + NumHistory);
+
+				for (auto i = 0; i < ChunkSize; ++i)
+					mid[i] = 0.f;
+				for (auto p = 0; p < NumPoints; ++p)
+					for (auto i = 0; i < ChunkSize; ++i)
+						mid[i] += w[p] * x[i + p];
+				for (auto i = 0; i < ChunkSize; ++i)
+				{
+					y[i * 2] = mid[i];
+					y[i * 2 + 1] = x[i + NumPoints / 2];
+				}
+				std::copy(y, y + n * 2, samples + i0 * 2);
+			}
+			std::copy(newHistory, newHistory + NumHistory, history);
+		}
+		/* split into even and odd inputs, so that the taps are read contiguously */
+		template<int NumPoints>
+		static void decimate(float* samples, float* history, int numSamples) noexcept
+		{
+			static constexpr int NumEven = NumPoints - 1;
+			static constexpr int NumOdd = NumPoints / 2;
+			const auto& w = Midpoint<NumPoints>::Weights;
+
+			float x[ChunkSize * 2] = {}, even[NumEven + ChunkSize], odd[NumOdd + ChunkSize], y[ChunkSize];
+			std::copy(history, history + NumEven, even);
+			std::copy(history + NumEven, history + NumEven + NumOdd, odd);
+			const auto numOutputs = numSamples / 2;
+			for (auto i0 = 0; i0 < numOutputs; i0 += ChunkSize)
+			{
+				const auto n = std::min(ChunkSize, numOutputs - i0);
+				std::copy(samples + i0 * 2, samples + (i0 + n) * 2, x);
+				for (auto i = 0; i < ChunkSize; ++i)
+				{
+					even[NumEven + i] = x[i * 2];
+					odd[NumOdd + i] = x[i * 2 + 1];
+				}
+
+				for (auto i = 0; i < ChunkSize; ++i)
+					y[i] = 0.f;
+				for (auto p = 0; p < NumPoints; ++p)
+					for (auto i = 0; i < ChunkSize; ++i)
+						y[i] += w[p] * even[i + p];
+				for (auto i = 0; i < ChunkSize; ++i)
+					y[i] = .5f * (y[i] + odd[i]);
+				std::copy(y, y + n, samples + i0);
+
+				std::copy(even + n, even + n + NumEven, even);
+				std::copy(odd + n, odd + n + NumOdd, odd);
+			}
+			std::copy(even, even + NumEven, history);
+			std::copy(odd, odd + NumOdd, history + NumEven);
+		}
+	};
+}
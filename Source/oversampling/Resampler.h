@@ -0,0 +1,196 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+namespace oversampling
+{
+	/*
+	* arbitrary ratio resampler between the host's rate and a fixed internal rate.
+	*
+	* both directions interpolate with the same windowed sinc, lowpass at the lower one of the two nyquists,
+	* read from a polyphase table with linear interpolation between the phases.
+	* the taps of an output sample are interpolated once, then every channel is a plain dot product.
+	* below the host's rate the kernel is stretched, so it gets wider and the latency grows.
+	* the kernel is centred on the interpolated time, so no fractional delay is introduced:
+	* the output is the input delayed by exactly getLatency() host samples.
+	* the number of internal samples per block varies by 1 when the ratio isn't an integer.
+	*/
+	struct Resampler
+	{
+		static constexpr int HalfTaps = 24; // in samples of the lower rate
+		static constexpr int NumPhases = 512; // per host sample
+		static constexpr double PassbandRatio = .9; // cutoff relative to the lower nyquist
+
+		using Buffer = std::vector<float>;
+
+		Resampler() :
+			table(),
+			inHist(), midHist(),
+			coefs(),
+			ratio(1.), ratioInv(1.), scale(1.),
+			numUp(0), numIn(0), numOut(0),
+			inMask(0), midMask(0),
+			numChannels(0), halfTaps(HalfTaps)
+		{
+			makeTable();
+		}
+
+		void prepare(double sampleRate, double internalRate, int blockSize, int _numChannels)
+		{
+			numChannels = _numChannels;
+			ratio = internalRate / sampleRate;
+			ratioInv = 1. / ratio;
+			scale = std::min(1., ratio);
+			halfTaps = static_cast<int>(std::ceil(static_cast<double>(HalfTaps) / scale));
+			inMask = nextPowerOf2(blockSize + 4 * halfTaps + 2) - 1;
+			midMask = nextPowerOf2(static_cast<int>(std::ceil(static_cast<double>(blockSize + 4 * halfTaps + 2) * ratio)) + 2) - 1;
+			inHist.assign(numChannels, Buffer(inMask + 1, 0.f));
+			midHist.assign(numChannels, Buffer(midMask + 1, 0.f));
+			const auto halfWidthDown = static_cast<double>(HalfTaps) / scale * ratio;
+			coefs.assign(std::max(2 * halfTaps, static_cast<int>(2. * halfWidthDown) + 2), 0.f);
+			numUp = numIn = numOut = 0;
+		}
+
+		/* upper bound of internal samples per block */
+		int getMaxNumSamplesUp(int blockSize) const noexcept
+		{
+			return static_cast<int>(std::ceil(static_cast<double>(blockSize) * ratio)) + 1;
+		}
+		int getLatency() const noexcept { return 2 * halfTaps; }
+
+		/* returns the number of internal samples written to samplesUp */
+		int upsample(const float* const* samplesIn, float* const* samplesUp, int numChannelsIn, int numSamples) noexcept
+		{
+			const auto numChannelsUp = std::min(numChannelsIn, numChannels);
+			for (auto ch = 0; ch < numChannelsUp; ++ch)
+			{
+				auto& hist = inHist[ch];
+				for (auto s = 0; s < numSamples; ++s)
+					hist[(numIn + s) & inMask] = samplesIn[ch][s];
+			}
+			numIn += numSamples;
+
+			// internal sample n sits at host time n / ratio and needs halfTaps host samples after it
+			const auto lastIn = numIn - 1;
+			auto numSamplesUp = 0;
+			for (;; ++numSamplesUp)
+			{
+				const auto n = numUp + numSamplesUp;
+				const auto t = static_cast<double>(n) * ratioInv;
+				const auto i0 = static_cast<long long>(std::floor(t));
+				if (i0 + halfTaps > lastIn)
+					break;
+				const auto frac = t - static_cast<double>(i0);
+				const auto numTaps = 2 * halfTaps;
+				for (auto k = 0; k < numTaps; ++k)
+					coefs[k] = kernel(frac - static_cast<double>(k - halfTaps + 1));
+				const auto first = i0 - halfTaps + 1;
+				for (auto ch = 0; ch < numChannelsUp; ++ch)
+				{
+					const auto& hist = inHist[ch];
+					auto y = 0.f;
+					for (auto k = 0; k < numTaps; ++k)
+						y += hist[(first + k) & inMask] * coefs[k];
+					samplesUp[ch][numSamplesUp] = y;
+				}
+			}
+			numUp += numSamplesUp;
+			return numSamplesUp;
+		}
+
+		/* writes exactly numSamples host samples */
+		void downsample(const float* const* samplesUp, int numSamplesUp, float* const* samplesOut, int numChannelsOut, int numSamples) noexcept
+		{
+			const auto numChannelsDown = std::min(numChannelsOut, numChannels);
+			const auto firstUp = numUp - numSamplesUp;
+			for (auto ch = 0; ch < numChannelsDown; ++ch)
+			{
+				auto& hist = midHist[ch];
+				for (auto s = 0; s < numSamplesUp; ++s)
+					hist[(firstUp + s) & midMask] = samplesUp[ch][s];
+			}
+
+			// host sample m is read at internal time (m - latency) * ratio
+			const auto halfWidth = static_cast<double>(HalfTaps) / scale * ratio;
+			const auto gain = static_cast<float>(ratioInv);
+			for (auto s = 0; s < numSamples; ++s)
+			{
+				const auto m = numOut + s - getLatency();
+				if (m < 0)
+				{
+					for (auto ch = 0; ch < numChannelsDown; ++ch)
+						samplesOut[ch][s] = 0.f;
+					continue;
+				}
+				const auto t = static_cast<double>(m) * ratio;
+				const auto j0 = static_cast<long long>(std::ceil(t - halfWidth));
+				const auto j1 = static_cast<long long>(std::floor(t + halfWidth));
+				const auto numTaps = static_cast<int>(j1 - j0 + 1);
+				for (auto k = 0; k < numTaps; ++k)
+					coefs[k] = kernel((static_cast<double>(j0 + k) - t) * ratioInv);
+				for (auto ch = 0; ch < numChannelsDown; ++ch)
+				{
+					const auto& hist = midHist[ch];
+					auto y = 0.f;
+					for (auto k = 0; k < numTaps; ++k)
+						y += hist[(j0 + k) & midMask] * coefs[k];
+					samplesOut[ch][s] = y * gain;
+				}
+			}
+			numOut += numSamples;
+		}
+		/* copies the state of the first channel to the others */
+		void syncChannels() noexcept
+		{
+			for (auto ch = 1; ch < numChannels; ++ch)
+			{
+				inHist[ch] = inHist[0];
+				midHist[ch] = midHist[0];
+			}
+		}
+	protected:
+		Buffer table;
+		std::vector<Buffer> inHist, midHist;
+		Buffer coefs; // of the output sample being computed, the same for every channel
+		double ratio, ratioInv, scale;
+		long long numUp, numIn, numOut;
+		long long inMask, midMask;
+		int numChannels, halfTaps; // halfTaps in host samples
+
+		static int nextPowerOf2(int n) noexcept
+		{
+			auto p = 1;
+			while (p < n)
+				p <<= 1;
+			return p;
+		}
+
+		void makeTable()
+		{ // blackman windowed sinc over [-HalfTaps, HalfTaps] samples of the lower rate
+			static constexpr double pi = 3.14159265358979;
+			const auto size = 2 * HalfTaps * NumPhases + 2;
+			table.resize(size, 0.f);
+			for (auto i = 0; i < size - 1; ++i)
+			{
+				const auto x = static_cast<double>(i) / NumPhases - HalfTaps;
+				const auto sx = PassbandRatio * x;
+				const auto sinc = sx == 0. ? 1. : std::sin(pi * sx) / (pi * sx);
+				const auto w = .5 + x / (2. * HalfTaps);
+				const auto blackman = .42 - .5 * std::cos(2. * pi * w) + .08 * std::cos(4. * pi * w);
+				table[i] = static_cast<float>(PassbandRatio * sinc * blackman);
+			}
+		}
+
+		/* x in host samples, 0 outside of the kernel. scaled down to the internal nyquist if that is lower */
+		float kernel(double x) const noexcept
+		{
+			const auto idx = (x * scale + HalfTaps) * NumPhases;
+			if (idx < 0. || idx >= static_cast<double>(2 * HalfTaps * NumPhases))
+				return 0.f;
+			const auto i = static_cast<int>(idx);
+			const auto frac = static_cast<float>(idx - i);
+			return static_cast<float>(scale) * (table[i] + frac * (table[i + 1] - table[i]));
+		}
+	};
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace oversampling
+{
+	/*
+	* per thread bump allocator for buffers that only live during one processBlock.
+	* plugin instances on one audio thread never run at the same time, so all of them share
+	* the same memory, which stays warm in the cache. state that has to survive the block
+	* (filters, delay lines) doesn't belong here.
+	*
+	* allocations are only valid until the Frame they were made in closes.
+	* reserve() announces the biggest frame an instance needs, from any thread, and grows the calling
+	* thread's arena right away. other threads' arenas grow when they open their next outermost frame,
+	* so if the host prepares on another thread than it processes on, the first block after a prepare
+	* can allocate. frames that need more than announced get extra blocks, earlier allocations never move.
+	*/
+	struct ScratchArena
+	{
+		static constexpr size_t Alignment = 64; // bytes
+		static constexpr size_t AlignmentFloats = Alignment / sizeof(float);
+
+		/* the calling thread's arena */
+		static ScratchArena& get() noexcept
+		{
+			thread_local ScratchArena arena;
+			return arena;
+		}
+
+		/* numFloats, including the padding of each allocation, see getSize() */
+		static void reserve(size_t numFloats)
+		{
+			auto& reserved = getReserved();
+			auto r = reserved.load();
+			while (r < numFloats && !reserved.compare_exchange_weak(r, numFloats)) {}
+			auto& arena = get();
+			if (arena.depth == 0) // nothing allocated from it is alive
+				arena.grow();
+		}
+
+		/* what allocate(numFloats) takes from the arena */
+		static size_t getSize(size_t numFloats) noexcept
+		{
+			return (numFloats + AlignmentFloats - 1) / AlignmentFloats * AlignmentFloats;
+		}
+
+		struct Frame
+		{
+			Frame() :
+				arena(get()),
+				blockIdx(0),
+				offset(0)
+			{
+				if (arena.depth++ == 0)
+				{ // the outermost frame starts from scratch, whatever was allocated outside of frames
+					arena.grow();
+					arena.blockIdx = arena.offset = 0;
+				}
+				blockIdx = arena.blockIdx;
+				offset = arena.offset;
+			}
+			~Frame()
+			{
+				arena.blockIdx = blockIdx;
+				arena.offset = offset;
+				--arena.depth;
+			}
+		protected:
+			ScratchArena& arena;
+			size_t blockIdx, offset;
+		};
+
+		/* Alignment aligned, uninitialized */
+		float* allocate(size_t numFloats)
+		{
+			numFloats = getSize(numFloats);
+			while (blockIdx < blocks.size() && offset + numFloats > blocks[blockIdx].size)
+			{
+				++blockIdx;
+				offset = 0;
+			}
+			if (blockIdx == blocks.size())
+				blocks.push_back(makeBlock(std::max(numFloats, getReserved().load())));
+			auto data = blocks[blockIdx].start + offset;
+			offset += numFloats;
+			return data;
+		}
+	protected:
+		struct Block
+		{
+			std::unique_ptr<float[]> memory;
+			float* start;
+			size_t size;
+		};
+
+		std::vector<Block> blocks;
+		size_t blockIdx, offset;
+		int depth;
+
+		ScratchArena() :
+			blocks(),
+			blockIdx(0), offset(0),
+			depth(0)
+		{}
+
+		static std::atomic<size_t>& getReserved() noexcept
+		{
+			static std::atomic<size_t> reserved(0);
+			return reserved;
+		}
+
+		static Block makeBlock(size_t numFloats)
+		{
+			Block block{ std::make_unique<float[]>(numFloats + AlignmentFloats), nullptr, numFloats };
+			const auto address = reinterpret_cast<std::uintptr_t>(block.memory.get());
+			block.start = block.memory.get() + (Alignment - address % Alignment) % Alignment / sizeof(float);
+			return block;
+		}
+
+		/* merges everything into one block of the reserved size, nothing is allocated while it runs */
+		void grow()
+		{
+			const auto reserved = getReserved().load();
+			auto capacity = static_cast<size_t>(0);
+			for (const auto& block : blocks)
+				capacity += block.size;
+			if (blocks.size() == 1 && capacity >= reserved)
+				return;
+			if (blocks.empty() && reserved == 0)
+				return;
+			blocks.clear();
+			blocks.push_back(makeBlock(std::max(capacity, reserved)));
+			blockIdx = offset = 0;
+		}
+	};
+}
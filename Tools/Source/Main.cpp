@@ -0,0 +1,194 @@
+#include <JuceHeader.h>
+#include "../../Source/PluginProcessor.h"
+#include "../../Source/Equivalence.h"
+#include "Stream.h"
+#include <iostream>
+#if JUCE_WINDOWS
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <csignal>
+#endif
+
+/*
+* command line tools around the plugin's processing chain, no host needed.
+*
+* replay <capture> [numWorst]
+*	feeds a capture recorded with the plugin's record button through a fresh instance,
+*	with the recorded prepares, block sizes and params in the recorded order,
+*	and prints the blocks that cost the most. the per stage csv of the graph's profiler goes next to the capture.
+*	the cpu governor still reacts to this machine's load, so its tier changes can differ from the recording.
+*
+* stream [--rate 48000] [--channels 2] [--block 64] [--format f32|s16] [--in <pipe>]
+*	processes raw interleaved pcm from stdin, or a named pipe, to stdout in blocks of a fixed size
+*	on a realtime thread, until the input ends. native byte order.
+*	the processing and end to end latency distributions go to stderr every 10 seconds of audio and at the end.
+*
+* test [seed] [numRuns]
+*	compares every optimized kernel to its reference on each instruction set this cpu has,
+*	prints the report as csv and exits with 1 if any kernel is out of its tolerance.
+*/
+namespace
+{
+	void printUsage()
+	{
+		std::cerr << "usage:\n"
+			<< "  replay <capture> [numWorst]\n"
+			<< "  stream [--rate 48000] [--channels 2] [--block 64] [--format f32|s16] [--in <pipe>]\n"
+			<< "  test [seed] [numRuns]\n";
+	}
+
+	juce::String getOption(const juce::StringArray& args, const juce::String& name, const juce::String& defaultValue)
+	{
+		const auto idx = args.indexOf(name);
+		return idx != -1 && idx + 1 < args.size() ? args[idx + 1] : defaultValue;
+	}
+
+	int replay(const juce::StringArray& args)
+	{
+		if (args.size() < 2)
+		{
+			printUsage();
+			return 1;
+		}
+		const auto file = juce::File::getCurrentWorkingDirectory().getChildFile(args[1]);
+		const auto numWorst = args.size() > 2 ? args[2].getIntValue() : 16;
+		if (!capture::Reader(file).isValid())
+		{
+			std::cerr << "not a capture: " << file.getFullPathName() << "\n";
+			return 1;
+		}
+
+		OversamplingTestAudioProcessor processor;
+		// offline blocks have to be rendered with the planned config, like in the session
+		processor.applyOfflinePlan(-1);
+		std::vector<std::atomic<float>*> params;
+		for (auto i = 0; i < static_cast<int>(param::ID::EnumSize); ++i)
+			params.push_back(processor.apvts.getRawParameterValue(param::getID(static_cast<param::ID>(i))));
+		juce::MidiBuffer midi;
+#if PROFILER_ENABLED
+		processor.graph.getProfiler().startLogging(file.withFileExtension(".csv"));
+#endif
+
+		const auto report = capture::replay(file,
+			[&](const capture::Record& record)
+			{
+				processor.setNonRealtime((record.flags & capture::NonRealtime) != 0);
+				processor.oversampling.setEnabled((record.flags & capture::OversamplingEnabled) != 0);
+				processor.oversampling.setDraft((record.flags & capture::Draft) != 0);
+				processor.setPlayConfigDetails(record.numChannelsIn, record.numChannels, record.sampleRate, record.numSamples);
+				processor.prepareToPlay(record.sampleRate, record.numSamples);
+			},
+			[&](juce::AudioBuffer<float>& buffer, const std::vector<float>& values, bool bypassed)
+			{
+				const auto numParams = static_cast<int>(std::min(values.size(), params.size()));
+				for (auto i = 0; i < numParams; ++i)
+					params[i]->store(values[i]);
+				// the raw values don't reach the listeners, and there's no message loop to run the oversampling's timer
+				const auto internalRate = static_cast<int>(param::ID::InternalRate);
+				if (internalRate < numParams)
+					processor.parameterChanged(param::getID(param::ID::InternalRate), values[internalRate]);
+				processor.oversampling.update();
+				if (bypassed)
+					processor.processBlockBypassed(buffer, midi);
+				else
+					processor.processBlock(buffer, midi);
+			},
+			numWorst);
+
+#if PROFILER_ENABLED
+		juce::Thread::sleep(2 * profiler::AggregationIntervalMs); // let the profiler write the last rows
+		processor.graph.getProfiler().stopLogging();
+#endif
+		std::cout << report.toString();
+		if (report.numDropped != 0)
+			std::cout << report.numDropped << " blocks were dropped while recording, the replay has gaps there\n";
+		return 0;
+	}
+
+	int streamPipes(const juce::StringArray& args)
+	{
+		const stream::Settings settings{
+			getOption(args, "--rate", "48000").getDoubleValue(),
+			getOption(args, "--channels", "2").getIntValue(),
+			getOption(args, "--block", "64").getIntValue(),
+			getOption(args, "--format", "f32") == "s16" ? stream::Format::Int16 : stream::Format::Float32
+		};
+		if (settings.sampleRate <= 0. || settings.numChannels < 1 || settings.numChannels > 2 || settings.blockSize < 1)
+		{
+			printUsage();
+			return 1;
+		}
+
+		auto in = stdin;
+		const auto inPath = getOption(args, "--in", {});
+		if (inPath.isNotEmpty())
+		{
+			in = std::fopen(juce::File::getCurrentWorkingDirectory().getChildFile(inPath).getFullPathName().toRawUTF8(), "rb");
+			if (in == nullptr)
+			{
+				std::cerr << "can't open " << inPath << "\n";
+				return 1;
+			}
+		}
+#if JUCE_WINDOWS
+		_setmode(_fileno(stdin), _O_BINARY);
+		_setmode(_fileno(stdout), _O_BINARY);
+#else
+		// a closed stdout has to show up as a failed write, so the report still gets printed
+		std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+		OversamplingTestAudioProcessor processor;
+		processor.setNonRealtime(false);
+		processor.setPlayConfigDetails(settings.numChannels, settings.numChannels, settings.sampleRate, settings.blockSize);
+		processor.prepareToPlay(settings.sampleRate, settings.blockSize);
+		std::cerr << "latency " << processor.getLatencySamples() << " samples\n";
+
+		stream::Runner runner(processor, settings, in, stdout);
+		runner.run(std::cerr);
+		std::cerr << runner.getReport();
+		if (in != stdin)
+			std::fclose(in);
+		return 0;
+	}
+
+	int test(const juce::StringArray& args)
+	{
+		const auto seed = args.size() > 1 ? args[1].getLargeIntValue() : 420;
+		const auto numRuns = args.size() > 2 ? args[2].getIntValue() : 4;
+		if (numRuns < 1)
+		{
+			printUsage();
+			return 1;
+		}
+		const auto report = equivalence::Harness(seed, numRuns).run();
+		std::cout << report.toString();
+		for (const auto& r : report.results)
+			if (!r.passed())
+				std::cerr << "failed: " << r.kernel << " " << oversampling::toString(r.isa) << "\n";
+		return report.passed() ? 0 : 1;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	juce::ScopedJuceInitialiser_GUI juceInit; // the processor and its profiler need the message manager
+	juce::StringArray args;
+	for (auto i = 1; i < argc; ++i)
+		args.add(argv[i]);
+
+	if (args.isEmpty())
+	{
+		printUsage();
+		return 1;
+	}
+	if (args[0] == "replay")
+		return replay(args);
+	if (args[0] == "stream")
+		return streamPipes(args);
+	if (args[0] == "test")
+		return test(args);
+	printUsage();
+	return 1;
+}
@@ -0,0 +1,341 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <vector>
+#if JUCE_WINDOWS
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+/*
+* runs an AudioProcessor on an endless stream of raw interleaved pcm, e.g. from a pipe,
+* and measures how long every block takes on its way through.
+*
+* input thread -> realtime processing thread -> output (the thread that calls Runner::run),
+* connected by a ring of preallocated blocks. the input waits while the ring is full,
+* so a producer faster than realtime shows up as queueing in the end to end latency, not as drops.
+* the input is read from its file descriptor, not through stdio, and only once it has data,
+* so the input thread never hangs in a read when the output closes first.
+*/
+namespace stream
+{
+	enum class Format { Float32, Int16 };
+
+	struct Settings
+	{
+		double sampleRate;
+		int numChannels, blockSize;
+		Format format;
+	};
+
+	/* durations in ms, binned finely enough for percentiles and preallocated */
+	struct Histogram
+	{
+		static constexpr double BinMs = .005;
+		static constexpr int NumBins = 1 << 16; // everything above ~330ms goes into the last bin
+
+		Histogram() :
+			bins(NumBins, 0),
+			num(0),
+			sumMs(0.), maxMs(0.)
+		{}
+		void add(double ms) noexcept
+		{
+			const auto bin = std::min(NumBins - 1, static_cast<int>(ms / BinMs));
+			++bins[bin];
+			++num;
+			sumMs += ms;
+			maxMs = std::max(maxMs, ms);
+		}
+		juce::int64 getNum() const noexcept { return num; }
+		double getMean() const noexcept { return num == 0 ? 0. : sumMs / static_cast<double>(num); }
+		double getMax() const noexcept { return maxMs; }
+		/* upper edge of the bin the p-th fraction of the values falls into */
+		double getPercentile(double p) const noexcept
+		{
+			const auto target = static_cast<juce::int64>(std::ceil(p * static_cast<double>(num)));
+			juce::int64 count = 0;
+			for (auto b = 0; b < NumBins - 1; ++b)
+			{
+				count += bins[b];
+				if (count >= target)
+					return std::min(maxMs, static_cast<double>(b + 1) * BinMs);
+			}
+			return maxMs;
+		}
+		juce::String toString() const
+		{
+			return "mean " + juce::String(getMean(), 3) + " | p50 " + juce::String(getPercentile(.5), 3)
+				+ " | p99 " + juce::String(getPercentile(.99), 3) + " | p99.9 " + juce::String(getPercentile(.999), 3)
+				+ " | max " + juce::String(getMax(), 3) + " ms";
+		}
+	protected:
+		std::vector<juce::int64> bins;
+		juce::int64 num;
+		double sumMs, maxMs;
+	};
+
+	struct Runner
+	{
+		static constexpr int NumSlots = 8;
+		static constexpr int WaitTimeoutMs = 100;
+		static constexpr double ReportIntervalSeconds = 10.;
+
+		Runner(juce::AudioProcessor& p, const Settings& s, std::FILE* _in, std::FILE* _out) :
+			processor(p),
+			settings(s),
+			in(_in), out(_out),
+			slots(),
+			buffer(s.numChannels, s.blockSize),
+			midi(),
+			rawIn(static_cast<size_t>(s.blockSize * getFrameSize())),
+			rawOut(rawIn.size()),
+			numRead(0), numProcessed(0), numWritten(0),
+			inputDone(false), processingDone(false),
+			readEvent(), processedEvent(), writtenEvent(),
+			input(*this), processing(*this),
+			processTimes(), endToEndTimes(),
+			numOverruns(0)
+		{
+			for (auto& slot : slots)
+				slot = { std::vector<float>(static_cast<size_t>(s.numChannels * s.blockSize), 0.f), 0, 0, 0 };
+		}
+
+		/* returns once the input ended and everything was written, or the output was closed */
+		void run(std::ostream& log)
+		{
+			const auto tickToMs = 1000. / static_cast<double>(juce::Time::getHighResolutionTicksPerSecond());
+			const auto blocksPerReport = std::max(1, static_cast<int>(ReportIntervalSeconds * settings.sampleRate / settings.blockSize));
+			input.startThread();
+			processing.startRealtimeThread(juce::Thread::RealtimeOptions()
+				.withApproximateAudioProcessingTime(settings.blockSize, settings.sampleRate));
+
+			for (;;)
+			{
+				const auto idx = numWritten.load();
+				if (idx == numProcessed.load())
+				{
+					if (processingDone.load() && idx == numProcessed.load())
+						break;
+					processedEvent.wait(WaitTimeoutMs);
+					continue;
+				}
+				const auto& slot = slots[idx % NumSlots];
+				toRaw(slot.samples.data(), rawOut.data(), slot.numSamples * settings.numChannels);
+				const auto numWrittenFrames = std::fwrite(rawOut.data(), static_cast<size_t>(getFrameSize()), static_cast<size_t>(slot.numSamples), out);
+				// a closed output mostly shows up in the flush, the block was only buffered before
+				const auto closed = std::fflush(out) != 0 || numWrittenFrames != static_cast<size_t>(slot.numSamples);
+
+				const auto processMs = static_cast<double>(slot.processTicks) * tickToMs;
+				processTimes.add(processMs);
+				endToEndTimes.add(static_cast<double>(juce::Time::getHighResolutionTicks() - slot.readTicks) * tickToMs);
+				if (processMs > 1000. * slot.numSamples / settings.sampleRate)
+					++numOverruns;
+				numWritten.store(idx + 1); // the input can reuse the slot from here on
+				writtenEvent.signal();
+
+				if (closed)
+					break; // nobody's listening anymore
+				if ((idx + 1) % blocksPerReport == 0)
+					log << getReport() << std::flush;
+			}
+			processing.stopThread(1000);
+			input.stopThread(1000);
+		}
+
+		juce::String getReport() const
+		{
+			return "blocks " + juce::String(processTimes.getNum()) + " | overruns " + juce::String(numOverruns) + "\n"
+				+ "process: " + processTimes.toString() + "\n"
+				+ "end to end: " + endToEndTimes.toString() + "\n";
+		}
+	protected:
+		/* one block on its way from the input to the output, interleaved */
+		struct Slot
+		{
+			std::vector<float> samples;
+			juce::int64 readTicks, processTicks;
+			int numSamples;
+		};
+
+		struct Input :
+			public juce::Thread
+		{
+			Input(Runner& r) :
+				juce::Thread("StreamInput"),
+				runner(r)
+			{}
+			void run() override { runner.readInput(*this); }
+		protected:
+			Runner& runner;
+		};
+		struct Processing :
+			public juce::Thread
+		{
+			Processing(Runner& r) :
+				juce::Thread("StreamProcessing"),
+				runner(r)
+			{}
+			void run() override { runner.processInput(*this); }
+		protected:
+			Runner& runner;
+		};
+
+		juce::AudioProcessor& processor;
+		Settings settings;
+		std::FILE *in, *out;
+		std::array<Slot, NumSlots> slots;
+		juce::AudioBuffer<float> buffer;
+		juce::MidiBuffer midi;
+		std::vector<char> rawIn, rawOut;
+		std::atomic<juce::int64> numRead, numProcessed, numWritten;
+		std::atomic<bool> inputDone, processingDone;
+		juce::WaitableEvent readEvent, processedEvent, writtenEvent;
+		Input input;
+		Processing processing;
+		Histogram processTimes, endToEndTimes;
+		juce::int64 numOverruns;
+
+		int getFrameSize() const noexcept
+		{
+			return settings.numChannels * (settings.format == Format::Int16 ? 2 : 4);
+		}
+
+		void fromRaw(const char* raw, float* samples, int num) const noexcept
+		{
+			if (settings.format == Format::Float32)
+				std::memcpy(samples, raw, static_cast<size_t>(num) * sizeof(float));
+			else
+				for (auto i = 0; i < num; ++i)
+				{
+					juce::int16 s;
+					std::memcpy(&s, raw + 2 * i, 2);
+					samples[i] = static_cast<float>(s) / 32768.f;
+				}
+		}
+		void toRaw(const float* samples, char* raw, int num) const noexcept
+		{
+			if (settings.format == Format::Float32)
+				std::memcpy(raw, samples, static_cast<size_t>(num) * sizeof(float));
+			else
+				for (auto i = 0; i < num; ++i)
+				{
+					const auto s = static_cast<juce::int16>(juce::jlimit(-32768.f, 32767.f, std::round(samples[i] * 32768.f)));
+					std::memcpy(raw + 2 * i, &s, 2);
+				}
+		}
+
+		void readInput(juce::Thread& thread)
+		{
+			while (!thread.threadShouldExit())
+			{
+				const auto idx = numRead.load();
+				if (idx - numWritten.load() == NumSlots)
+				{
+					writtenEvent.wait(WaitTimeoutMs);
+					continue;
+				}
+				auto& slot = slots[idx % NumSlots];
+				const auto numFrames = readRaw(thread, rawIn.data(), static_cast<int>(rawIn.size())) / getFrameSize();
+				if (numFrames == 0 || thread.threadShouldExit())
+					break;
+				fromRaw(rawIn.data(), slot.samples.data(), numFrames * settings.numChannels);
+				slot.numSamples = numFrames;
+				slot.readTicks = juce::Time::getHighResolutionTicks();
+				numRead.store(idx + 1);
+				readEvent.signal();
+				if (numFrames != settings.blockSize)
+					break; // the last block of the stream
+			}
+			inputDone.store(true);
+			readEvent.signal();
+		}
+
+		/* less than numBytes only at the end of the input, or when the thread should exit */
+		int readRaw(juce::Thread& thread, char* dest, int numBytes)
+		{
+			auto numRead = 0;
+			while (numRead < numBytes && !thread.threadShouldExit())
+			{
+				if (!waitForInput())
+					continue;
+				const auto n = readSome(dest + numRead, numBytes - numRead);
+				if (n <= 0)
+					break; // end of the input, or an error
+				numRead += n;
+			}
+			return numRead;
+		}
+		/* false if nothing arrived for a while. a read after true doesn't block */
+		bool waitForInput() const
+		{
+#if JUCE_WINDOWS
+			DWORD numAvailable = 0;
+			// files don't block, and a pipe whose writer is gone reports the end in the read
+			if (!PeekNamedPipe(reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(in))), nullptr, 0, nullptr, &numAvailable, nullptr))
+				return true;
+			if (numAvailable != 0)
+				return true;
+			juce::Thread::sleep(1);
+			return false;
+#else
+			pollfd fd{ fileno(in), POLLIN, 0 };
+			const auto numReady = ::poll(&fd, 1, WaitTimeoutMs);
+			return numReady > 0 || (numReady < 0 && errno != EINTR);
+#endif
+		}
+		int readSome(char* dest, int numBytes) const
+		{
+#if JUCE_WINDOWS
+			return _read(_fileno(in), dest, static_cast<unsigned int>(numBytes));
+#else
+			return static_cast<int>(::read(fileno(in), dest, static_cast<size_t>(numBytes)));
+#endif
+		}
+
+		/* realtime thread, nothing in here allocates or locks */
+		void processInput(juce::Thread& thread)
+		{
+			while (!thread.threadShouldExit())
+			{
+				const auto idx = numProcessed.load();
+				if (idx == numRead.load())
+				{
+					if (inputDone.load() && idx == numRead.load())
+						break;
+					readEvent.wait(WaitTimeoutMs);
+					continue;
+				}
+				auto& slot = slots[idx % NumSlots];
+				const auto numChannels = settings.numChannels;
+				const auto numSamples = slot.numSamples;
+				auto samples = buffer.getArrayOfWritePointers();
+				for (auto ch = 0; ch < numChannels; ++ch)
+					for (auto s = 0; s < numSamples; ++s)
+						samples[ch][s] = slot.samples[s * numChannels + ch];
+
+				juce::AudioBuffer<float> block(samples, numChannels, numSamples);
+				const auto start = juce::Time::getHighResolutionTicks();
+				processor.processBlock(block, midi);
+				slot.processTicks = juce::Time::getHighResolutionTicks() - start;
+
+				for (auto ch = 0; ch < numChannels; ++ch)
+					for (auto s = 0; s < numSamples; ++s)
+						slot.samples[s * numChannels + ch] = samples[ch][s];
+				numProcessed.store(idx + 1);
+				processedEvent.signal();
+			}
+			processingDone.store(true);
+			processedEvent.signal();
+		}
+	};
+}